@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "analysis_pool.h"
+
+// Publish the result of a finished step, in step order when the pool asks for it
+static void publish(AnalysisPool *pool, const AnalysisJob *job, double seconds)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->in_order && pool->next_publish != job->step)
+    {
+        pthread_cond_wait(&pool->publish_turn, &pool->lock);
+    }
+    const AnalysisResult *result = &job->result;
+    switch (result->status)
+    {
+    case ANALYSIS_BLOBS:
+        printf("step %d: blob_number =%d\n", job->step, result->blob_number);
+        printf("step %d: blob_diameter =%f\n", job->step, result->blob_diameter);
+        printf("step %d: blob_area =%f\n", job->step, result->blob_area);
+        printf("step %d: overlap_ratio =%f\n", job->step, result->overlap_ratio);
+        break;
+    case ANALYSIS_NO_INPUT:
+        fprintf(stderr, "step %d: no analysis input arrived\n", job->step);
+        break;
+    case ANALYSIS_FAILED:
+        fprintf(stderr, "step %d: blob detection failed\n", job->step);
+        break;
+    case ANALYSIS_NO_RESULT:
+        break;
+    }
+    printf("Step %d analysed (%s) in %.3f s\n", job->step, job->quality == FULL ? "full" : "reduced", seconds);
+    pool->next_publish = job->step + 1;
+    pool->published++;
+    pool->running--;
+    pthread_cond_broadcast(&pool->publish_turn);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *analysis_worker(void *arg)
+{
+    AnalysisPool *pool = arg;
+    while (true)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->closed)
+        {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        if (pool->count == 0)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        AnalysisJob job = pool->jobs[pool->head];
+        pool->head = (pool->head + 1) % ANALYSIS_QUEUE_DEPTH;
+        pool->count--;
+        pool->running++;
+        pthread_cond_broadcast(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        job.result = (AnalysisResult){.status = ANALYSIS_NO_RESULT};
+        pool->analyse(job.quality, job.step, job.field, &job.result);
+        step_field_release(job.field);
+        gettimeofday(&end, NULL);
+        publish(pool, &job, (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+    }
+    return NULL;
+}
+
+void analysis_pool_start(AnalysisPool *pool, int num_workers, bool in_order, AnalysisFunc analyse)
+{
+    pool->head = 0;
+    pool->count = 0;
+    pool->running = 0;
+    pool->next_publish = 0;
+    pool->published = 0;
+    pool->in_order = in_order;
+    pool->closed = false;
+    pool->analyse = analyse;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+    pthread_cond_init(&pool->publish_turn, NULL);
+    if (num_workers < 1)
+    {
+        num_workers = 1;
+    }
+    if (num_workers > MAX_ANALYSIS_WORKERS)
+    {
+        num_workers = MAX_ANALYSIS_WORKERS;
+    }
+    pool->num_workers = 0;
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (pthread_create(&pool->workers[i], NULL, analysis_worker, pool) != 0)
+        {
+            perror("Failed to create analysis worker");
+            break;
+        }
+        pool->num_workers++;
+    }
+    if (pool->num_workers == 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Queue a completed step, waiting while the queue is full. Steps must be
+// submitted in order for in-order publication. The job takes over the
+// reference to field.
+void analysis_pool_submit(AnalysisPool *pool, int step, DataQuality quality, StepField *field)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == ANALYSIS_QUEUE_DEPTH)
+    {
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+    }
+    pool->jobs[(pool->head + pool->count) % ANALYSIS_QUEUE_DEPTH] = (AnalysisJob){.step = step, .quality = quality, .field = field};
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Backpressure for the receiving threads: wait until the queue has room
+void analysis_pool_wait_for_room(AnalysisPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == ANALYSIS_QUEUE_DEPTH && !pool->closed)
+    {
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Steps handed to the pool and not published yet
+int analysis_pool_backlog(AnalysisPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    int backlog = pool->count + pool->running;
+    pthread_mutex_unlock(&pool->lock);
+    return backlog;
+}
+
+// Finish the queued steps and join the workers
+void analysis_pool_stop(AnalysisPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->closed = true;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_workers; i++)
+    {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->publish_turn);
+}
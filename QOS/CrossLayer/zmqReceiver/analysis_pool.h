@@ -0,0 +1,79 @@
+#ifndef ANALYSIS_POOL_H
+#define ANALYSIS_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "step_types.h"
+
+// Analysis scripts running at once
+#ifndef ANALYSIS_WORKERS
+#define ANALYSIS_WORKERS 2
+#endif
+#define MAX_ANALYSIS_WORKERS 16
+
+// Completed steps waiting for a worker; when full, the processor and the
+// receiving threads wait before taking on more steps
+#ifndef ANALYSIS_QUEUE_DEPTH
+#define ANALYSIS_QUEUE_DEPTH 4
+#endif
+
+// 1: results are published in step order even when a later step finishes first
+#ifndef ANALYSIS_IN_ORDER
+#define ANALYSIS_IN_ORDER 1
+#endif
+
+typedef enum
+{
+    ANALYSIS_NO_RESULT, // the analysis reports nothing (off, or the Python scripts)
+    ANALYSIS_BLOBS,
+    ANALYSIS_NO_INPUT,
+    ANALYSIS_FAILED,
+} AnalysisStatus;
+
+// What an analysis found, printed when the step's turn to publish comes
+typedef struct
+{
+    AnalysisStatus status;
+    int blob_number;
+    double blob_diameter;
+    double blob_area;
+    double overlap_ratio;
+} AnalysisResult;
+
+typedef void (*AnalysisFunc)(DataQuality quality, int step, const StepField *field, AnalysisResult *result);
+
+typedef struct
+{
+    int step;
+    DataQuality quality;
+    StepField *field; // reference held until the analysis is done
+    AnalysisResult result;
+} AnalysisJob;
+
+// Fixed set of workers fed from a bounded FIFO of completed steps
+typedef struct
+{
+    AnalysisJob jobs[ANALYSIS_QUEUE_DEPTH];
+    int head;
+    int count;
+    int running;
+    int next_publish; // step whose result is published next (in-order mode)
+    int published;
+    bool in_order;
+    bool closed;
+    AnalysisFunc analyse;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t publish_turn;
+    pthread_t workers[MAX_ANALYSIS_WORKERS];
+    int num_workers;
+} AnalysisPool;
+
+void analysis_pool_start(AnalysisPool *pool, int num_workers, bool in_order, AnalysisFunc analyse);
+void analysis_pool_submit(AnalysisPool *pool, int step, DataQuality quality, StepField *field);
+void analysis_pool_wait_for_room(AnalysisPool *pool);
+int analysis_pool_backlog(AnalysisPool *pool);
+void analysis_pool_stop(AnalysisPool *pool);
+
+#endif // ANALYSIS_POOL_H
@@ -0,0 +1,1562 @@
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "blob_detect.h"
+
+// matplotlib's jet, as (x, value) breakpoints per channel
+typedef struct
+{
+    double x;
+    double value;
+} ColorStop;
+
+static const ColorStop jet_red[] = {{0.0, 0.0}, {0.35, 0.0}, {0.66, 1.0}, {0.89, 1.0}, {1.0, 0.5}};
+static const ColorStop jet_green[] = {{0.0, 0.0}, {0.125, 0.0}, {0.375, 1.0}, {0.64, 1.0}, {0.91, 0.0}, {1.0, 0.0}};
+static const ColorStop jet_blue[] = {{0.0, 0.5}, {0.11, 1.0}, {0.34, 1.0}, {0.65, 0.0}, {1.0, 0.0}};
+
+#define JET_LUT_SIZE 256
+
+// Threads binning nodes, each one sums into its own copy of the image
+#define BLOB_RASTER_THREADS 8
+
+// The mask scripts apply to the BGR image before the detector (cv2.inRange)
+static const uint8_t mask_lower[3] = {0, 0, 100};
+static const uint8_t mask_upper[3] = {204, 204, 255};
+
+void blob_params_init(BlobParams *params, BlobLayout layout, double min_convexity)
+{
+    params->width = BLOB_IMAGE_SIZE;
+    params->height = BLOB_IMAGE_SIZE;
+    if (layout == BLOB_LAYOUT_FILL)
+    {
+        params->left = 0.0;
+        params->right = 1.0;
+        params->bottom = 0.0;
+        params->top = 1.0;
+    }
+    else
+    {
+        params->left = 0.125;
+        params->right = 0.9;
+        params->bottom = 0.11;
+        params->top = 0.88;
+    }
+    params->levels = BLOB_LEVELS;
+    params->triangulate_points = BLOB_TRIANGULATE_POINTS;
+    params->min_threshold = 10;
+    params->max_threshold = 200;
+    params->threshold_step = 10;
+    params->min_repeatability = 2;
+    params->min_dist_between_blobs = 10;
+    params->min_area = 120;
+    params->max_area = 5000;
+    params->min_convexity = min_convexity;
+    params->min_inertia_ratio = 0.1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    params->threads = cpus < 1 ? 1 : cpus > BLOB_MAX_THREADS ? BLOB_MAX_THREADS
+                                                              : (int)cpus;
+}
+
+// Linear segments evaluated the way matplotlib builds its lookup table, in
+// entry units, so values landing on .5 round to the same byte
+static double color_at(const ColorStop *stops, int count, int index)
+{
+    double x = (JET_LUT_SIZE - 1) * (index * (1.0 / (JET_LUT_SIZE - 1)));
+    for (int i = 1; i < count; i++)
+    {
+        double x0 = stops[i - 1].x * (JET_LUT_SIZE - 1), x1 = stops[i].x * (JET_LUT_SIZE - 1);
+        if (x <= x1)
+        {
+            return (x - x0) / (x1 - x0) * (stops[i].value - stops[i - 1].value) + stops[i - 1].value;
+        }
+    }
+    return stops[count - 1].value;
+}
+
+// RGB of colormap entry index, rounded the way Agg stores 8-bit colours
+static void jet_rgb(int index, uint8_t rgb[3])
+{
+    double channels[3] = {
+        color_at(jet_red, sizeof(jet_red) / sizeof(jet_red[0]), index),
+        color_at(jet_green, sizeof(jet_green) / sizeof(jet_green[0]), index),
+        color_at(jet_blue, sizeof(jet_blue) / sizeof(jet_blue[0]), index)};
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = (uint8_t)(channels[c] * 255.0 + 0.5);
+    }
+}
+
+// Run fn on every argument in its own thread, the first one on the caller
+static void run_parallel(void *(*fn)(void *), void *args, size_t arg_size, int count)
+{
+    pthread_t threads[BLOB_MAX_THREADS];
+    bool started[BLOB_MAX_THREADS] = {false};
+    for (int i = 1; i < count; i++)
+    {
+        started[i] = pthread_create(&threads[i], NULL, fn, (char *)args + i * arg_size) == 0;
+        if (!started[i])
+        {
+            fn((char *)args + i * arg_size);
+        }
+    }
+    fn(args);
+    for (int i = 1; i < count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Rendering
+
+typedef struct
+{
+    double x0, y0;   // data coordinates of the axes' lower left corner
+    double sx, sy;   // pixels per data unit
+    double px0, py0; // axes' lower left corner in display pixels (y up)
+    int ax0, ax1;    // columns covered by the axes
+    int ay0, ay1;    // rows covered by the axes (image rows, y down)
+} Viewport;
+
+typedef struct
+{
+    const BlobField *fields;
+    int num_fields;
+    int part;
+    int parts;
+    const Viewport *view;
+    int width;
+    int height;
+    double *sum;
+    uint32_t *count;
+    double min_value, max_value;
+    double min_x, max_x, min_y, max_y;
+    // extreme points of every column and row, they hold the convex hull's vertices
+    double *col_low, *col_high, *row_left, *row_right;
+    double *col_low_x, *col_high_x, *row_left_y, *row_right_y;
+} RasterTask;
+
+static void field_slice(const RasterTask *task, const BlobField *field, size_t *begin, size_t *end)
+{
+    size_t per_part = field->count / task->parts;
+    *begin = per_part * task->part;
+    *end = task->part == task->parts - 1 ? field->count : *begin + per_part;
+}
+
+static void *find_extents(void *arg)
+{
+    RasterTask *task = arg;
+    double min_value = DBL_MAX, max_value = -DBL_MAX;
+    double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+    for (int f = 0; f < task->num_fields; f++)
+    {
+        const BlobField *field = &task->fields[f];
+        size_t begin, end;
+        field_slice(task, field, &begin, &end);
+        for (size_t i = begin; i < end; i++)
+        {
+            min_value = fmin(min_value, field->value[i]);
+            max_value = fmax(max_value, field->value[i]);
+            min_x = fmin(min_x, field->r[i]);
+            max_x = fmax(max_x, field->r[i]);
+            min_y = fmin(min_y, field->z[i]);
+            max_y = fmax(max_y, field->z[i]);
+        }
+    }
+    task->min_value = min_value;
+    task->max_value = max_value;
+    task->min_x = min_x;
+    task->max_x = max_x;
+    task->min_y = min_y;
+    task->max_y = max_y;
+    return NULL;
+}
+
+static void *bin_points(void *arg)
+{
+    RasterTask *task = arg;
+    const Viewport *view = task->view;
+    int width = task->width;
+    for (int f = 0; f < task->num_fields; f++)
+    {
+        const BlobField *field = &task->fields[f];
+        size_t begin, end;
+        field_slice(task, field, &begin, &end);
+        for (size_t i = begin; i < end; i++)
+        {
+            double x = field->r[i], y = field->z[i];
+            double dx = view->px0 + (x - view->x0) * view->sx;
+            double dy = task->height - (view->py0 + (y - view->y0) * view->sy);
+            int col = (int)dx, row = (int)dy;
+            col = col < view->ax0 ? view->ax0 : col > view->ax1 ? view->ax1
+                                                                 : col;
+            row = row < view->ay0 ? view->ay0 : row > view->ay1 ? view->ay1
+                                                                 : row;
+            size_t pixel = (size_t)row * width + col;
+            task->sum[pixel] += field->value[i];
+            task->count[pixel]++;
+            if (y < task->col_low[col])
+            {
+                task->col_low[col] = y;
+                task->col_low_x[col] = x;
+            }
+            if (y > task->col_high[col])
+            {
+                task->col_high[col] = y;
+                task->col_high_x[col] = x;
+            }
+            if (x < task->row_left[row])
+            {
+                task->row_left[row] = x;
+                task->row_left_y[row] = y;
+            }
+            if (x > task->row_right[row])
+            {
+                task->row_right[row] = x;
+                task->row_right_y[row] = y;
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    double x, y;
+} Point2;
+
+static double cross2(Point2 o, Point2 a, Point2 b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static int compare_point2(const void *a, const void *b)
+{
+    const Point2 *p = a, *q = b;
+    if (p->x != q->x)
+    {
+        return p->x < q->x ? -1 : 1;
+    }
+    return p->y < q->y ? -1 : p->y > q->y;
+}
+
+// Andrew's monotone chain, counter-clockwise, returns the number of vertices
+static int convex_hull2(Point2 *points, int n, Point2 *hull)
+{
+    qsort(points, n, sizeof(Point2), compare_point2);
+    int k = 0;
+    for (int i = 0; i < n; i++)
+    {
+        while (k >= 2 && cross2(hull[k - 2], hull[k - 1], points[i]) <= 0)
+        {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    for (int i = n - 2, lower = k + 1; i >= 0; i--)
+    {
+        while (k >= lower && cross2(hull[k - 2], hull[k - 1], points[i]) <= 0)
+        {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    return n > 1 ? k - 1 : n;
+}
+
+// Pixels inside the mesh that neither a node nor a triangle reached take the
+// mean of their filled neighbours, one ring per pass
+static void fill_gaps(double *value, uint8_t *state, int width, int height, const Viewport *view)
+{
+    // state: 0 outside the mesh, 1 empty, 2 filled
+    uint8_t *next = malloc((size_t)width * height);
+    bool changed = next != NULL;
+    while (changed)
+    {
+        changed = false;
+        memcpy(next, state, (size_t)width * height);
+        for (int row = view->ay0; row <= view->ay1; row++)
+        {
+            for (int col = view->ax0; col <= view->ax1; col++)
+            {
+                size_t pixel = (size_t)row * width + col;
+                if (state[pixel] != 1)
+                {
+                    continue;
+                }
+                double sum = 0.0;
+                int n = 0;
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    int r = row + dy;
+                    if (r < view->ay0 || r > view->ay1)
+                    {
+                        continue;
+                    }
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int c = col + dx;
+                        size_t neighbour = (size_t)r * width + c;
+                        if (c >= view->ax0 && c <= view->ax1 && state[neighbour] == 2)
+                        {
+                            sum += value[neighbour];
+                            n++;
+                        }
+                    }
+                }
+                if (n > 0)
+                {
+                    value[pixel] = sum / n;
+                    next[pixel] = 3;
+                    changed = true;
+                }
+            }
+        }
+        for (size_t pixel = 0; pixel < (size_t)width * height; pixel++)
+        {
+            state[pixel] = next[pixel] == 3 ? 2 : next[pixel];
+        }
+    }
+    free(next);
+}
+
+// Delaunay triangulation, Bowyer-Watson on data coordinates snapped to a 2^20 grid
+// so the orientation and in-circle tests are exact in 64/128-bit integers
+
+#define MESH_GRID (1 << 20)
+#define MESH_FAR (1 << 26) // super triangle corners, far enough to leave the hull alone
+
+typedef struct
+{
+    int64_t x, y;
+} MeshPoint;
+
+__extension__ typedef __int128 WideInt;
+
+typedef struct
+{
+    int32_t v[3]; // counter-clockwise
+    int32_t n[3]; // neighbour across the edge opposite v[i], -1 on the outside
+    uint32_t stamp;
+} MeshTriangle;
+
+typedef struct
+{
+    MeshPoint *points; // the nodes, then the three super triangle corners
+    int32_t num_points;
+    MeshTriangle *triangles;
+    int32_t num_triangles;
+    int32_t capacity;
+    int32_t *free_list;
+    int32_t num_free;
+    uint32_t stamp;
+    // cavity scratch
+    int32_t *stack;
+    int32_t *cavity;
+    int32_t scratch_capacity;
+} Mesh;
+
+static int64_t orient(MeshPoint a, MeshPoint b, MeshPoint c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// > 0 when d lies inside the circle through the counter-clockwise a, b, c
+static bool in_circle(MeshPoint a, MeshPoint b, MeshPoint c, MeshPoint d)
+{
+    WideInt adx = a.x - d.x, ady = a.y - d.y;
+    WideInt bdx = b.x - d.x, bdy = b.y - d.y;
+    WideInt cdx = c.x - d.x, cdy = c.y - d.y;
+    WideInt alift = adx * adx + ady * ady;
+    WideInt blift = bdx * bdx + bdy * bdy;
+    WideInt clift = cdx * cdx + cdy * cdy;
+    WideInt det = alift * (bdx * cdy - cdx * bdy) + blift * (cdx * ady - adx * cdy) + clift * (adx * bdy - bdx * ady);
+    return det > 0;
+}
+
+static int32_t new_triangle(Mesh *mesh, int32_t a, int32_t b, int32_t c)
+{
+    int32_t t;
+    if (mesh->num_free > 0)
+    {
+        t = mesh->free_list[--mesh->num_free];
+    }
+    else
+    {
+        if (mesh->num_triangles == mesh->capacity)
+        {
+            return -1;
+        }
+        t = mesh->num_triangles++;
+    }
+    mesh->triangles[t] = (MeshTriangle){{a, b, c}, {-1, -1, -1}, 0};
+    return t;
+}
+
+// Triangle holding p, walking from start; crosses the first edge p is behind,
+// beginning at a rotating edge so degenerate walks cannot cycle
+static int32_t locate(const Mesh *mesh, int32_t start, MeshPoint p)
+{
+    int32_t t = start;
+    unsigned turn = 0;
+    while (true)
+    {
+        const MeshTriangle *tri = &mesh->triangles[t];
+        int32_t next = -1;
+        for (int k = 0; k < 3; k++)
+        {
+            int i = (k + turn) % 3;
+            if (orient(mesh->points[tri->v[(i + 1) % 3]], mesh->points[tri->v[(i + 2) % 3]], p) < 0)
+            {
+                next = tri->n[i];
+                break;
+            }
+        }
+        if (next < 0)
+        {
+            return t;
+        }
+        t = next;
+        turn++;
+    }
+}
+
+static bool insert_point(Mesh *mesh, int32_t p, int32_t *last)
+{
+    MeshPoint point = mesh->points[p];
+    int32_t start = locate(mesh, *last, point);
+    for (int i = 0; i < 3; i++)
+    {
+        MeshPoint v = mesh->points[mesh->triangles[start].v[i]];
+        if (v.x == point.x && v.y == point.y)
+        {
+            return true; // duplicate node, the first one is kept
+        }
+    }
+
+    // Cavity: the triangles whose circumcircle holds the point, grown from start
+    uint32_t stamp = ++mesh->stamp;
+    int32_t num_stack = 0, num_cavity = 0;
+    mesh->stack[num_stack++] = start;
+    mesh->triangles[start].stamp = stamp;
+    while (num_stack > 0)
+    {
+        int32_t t = mesh->stack[--num_stack];
+        mesh->cavity[num_cavity++] = t;
+        for (int i = 0; i < 3; i++)
+        {
+            int32_t n = mesh->triangles[t].n[i];
+            if (n < 0 || mesh->triangles[n].stamp == stamp)
+            {
+                continue;
+            }
+            const MeshTriangle *tri = &mesh->triangles[n];
+            if (in_circle(mesh->points[tri->v[0]], mesh->points[tri->v[1]], mesh->points[tri->v[2]], point))
+            {
+                mesh->triangles[n].stamp = stamp;
+                if (num_stack == mesh->scratch_capacity || num_cavity + num_stack >= mesh->scratch_capacity)
+                {
+                    return false;
+                }
+                mesh->stack[num_stack++] = n;
+            }
+        }
+    }
+
+    // Fan the cavity's boundary edges to the point. Edge (a, b) of a cavity
+    // triangle becomes triangle (a, b, p); the new triangles are linked through
+    // their shared vertices once all exist. A cavity of m triangles has m + 2
+    // boundary edges.
+    int32_t first_new = -1;
+    int32_t boundary[3 * 64], num_boundary = 0;
+    int32_t *edges = num_cavity + 2 <= 64 ? boundary : malloc(sizeof(int32_t) * 3 * (num_cavity + 2));
+    if (edges == NULL)
+    {
+        return false;
+    }
+    for (int32_t c = 0; c < num_cavity; c++)
+    {
+        const MeshTriangle *tri = &mesh->triangles[mesh->cavity[c]];
+        for (int i = 0; i < 3; i++)
+        {
+            int32_t n = tri->n[i];
+            if (n >= 0 && mesh->triangles[n].stamp == stamp)
+            {
+                continue;
+            }
+            int32_t a = tri->v[(i + 1) % 3], b = tri->v[(i + 2) % 3];
+            edges[num_boundary++] = a;
+            edges[num_boundary++] = b;
+            edges[num_boundary++] = n;
+        }
+    }
+    for (int32_t c = 0; c < num_cavity; c++)
+    {
+        mesh->free_list[mesh->num_free++] = mesh->cavity[c];
+    }
+    // the search stack is empty again and holds the new triangles
+    int32_t *created = mesh->stack;
+    if (num_boundary / 3 > mesh->scratch_capacity)
+    {
+        if (edges != boundary)
+        {
+            free(edges);
+        }
+        return false;
+    }
+    for (int32_t e = 0; e < num_boundary / 3; e++)
+    {
+        int32_t a = edges[3 * e], b = edges[3 * e + 1], outside = edges[3 * e + 2];
+        int32_t t = new_triangle(mesh, a, b, p);
+        if (t < 0)
+        {
+            if (edges != boundary)
+            {
+                free(edges);
+            }
+            return false;
+        }
+        created[e] = t;
+        mesh->triangles[t].n[2] = outside;
+        if (outside >= 0)
+        {
+            MeshTriangle *other = &mesh->triangles[outside];
+            for (int i = 0; i < 3; i++)
+            {
+                if (other->v[(i + 1) % 3] == b && other->v[(i + 2) % 3] == a)
+                {
+                    other->n[i] = t;
+                }
+            }
+        }
+        first_new = t;
+    }
+    // (a, b, p): across v[0]=a lies edge (b, p), shared with the triangle starting at b;
+    // across v[1]=b lies edge (p, a), shared with the triangle ending at a
+    int32_t count = num_boundary / 3;
+    for (int32_t e = 0; e < count; e++)
+    {
+        MeshTriangle *tri = &mesh->triangles[created[e]];
+        for (int32_t f = 0; f < count; f++)
+        {
+            const MeshTriangle *other = &mesh->triangles[created[f]];
+            if (other->v[0] == tri->v[1])
+            {
+                tri->n[0] = created[f];
+            }
+            if (other->v[1] == tri->v[0])
+            {
+                tri->n[1] = created[f];
+            }
+        }
+    }
+    if (edges != boundary)
+    {
+        free(edges);
+    }
+    *last = first_new;
+    return true;
+}
+
+typedef struct
+{
+    uint32_t key;
+    int32_t index;
+} SortKey;
+
+static int compare_sort_key(const void *a, const void *b)
+{
+    const SortKey *p = a, *q = b;
+    return p->key < q->key ? -1 : p->key > q->key;
+}
+
+// Position along a Hilbert curve over a 2^16 grid, for a short walk between inserts
+static uint32_t hilbert_index(uint32_t x, uint32_t y)
+{
+    uint32_t d = 0;
+    for (uint32_t s = 1u << 15; s > 0; s >>= 1)
+    {
+        uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+typedef struct
+{
+    const Mesh *mesh;
+    const double *px, *py, *pv; // node positions in image pixels (y down) and values
+    double *value;
+    uint8_t *state;
+    int width;
+    int row_begin, row_end;
+    int col_begin, col_end;
+} TriangleRaster;
+
+// Linear interpolation inside every triangle at the pixel centres of this row band
+static void *raster_triangles(void *arg)
+{
+    TriangleRaster *task = arg;
+    const Mesh *mesh = task->mesh;
+    int32_t nodes = mesh->num_points - 3;
+    for (int32_t t = 0; t < mesh->num_triangles; t++)
+    {
+        const MeshTriangle *tri = &mesh->triangles[t];
+        if (tri->stamp == UINT32_MAX || tri->v[0] >= nodes || tri->v[1] >= nodes || tri->v[2] >= nodes)
+        {
+            continue;
+        }
+        int32_t a = tri->v[0], b = tri->v[1], c = tri->v[2];
+        double ax = task->px[a], ay = task->py[a], bx = task->px[b], by = task->py[b], cx = task->px[c], cy = task->py[c];
+        double area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+        if (area == 0.0)
+        {
+            continue;
+        }
+        int row0 = (int)ceil(fmin(ay, fmin(by, cy)) - 0.5), row1 = (int)floor(fmax(ay, fmax(by, cy)) - 0.5);
+        int col0 = (int)ceil(fmin(ax, fmin(bx, cx)) - 0.5), col1 = (int)floor(fmax(ax, fmax(bx, cx)) - 0.5);
+        row0 = row0 < task->row_begin ? task->row_begin : row0;
+        row1 = row1 >= task->row_end ? task->row_end - 1 : row1;
+        col0 = col0 < task->col_begin ? task->col_begin : col0;
+        col1 = col1 >= task->col_end ? task->col_end - 1 : col1;
+        double inverse = 1.0 / area;
+        for (int row = row0; row <= row1; row++)
+        {
+            double y = row + 0.5;
+            for (int col = col0; col <= col1; col++)
+            {
+                double x = col + 0.5;
+                double wa = ((bx - x) * (cy - y) - (by - y) * (cx - x)) * inverse;
+                double wb = ((cx - x) * (ay - y) - (cy - y) * (ax - x)) * inverse;
+                double wc = 1.0 - wa - wb;
+                if (wa < 0 || wb < 0 || wc < 0)
+                {
+                    continue;
+                }
+                size_t pixel = (size_t)row * task->width + col;
+                task->value[pixel] = wa * task->pv[a] + wb * task->pv[b] + wc * task->pv[c];
+                task->state[pixel] = 2;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Triangulates the nodes and draws the interpolated field into value, marking
+// covered pixels in state. Returns false when the mesh could not be built.
+static bool interpolate_field(const BlobField *fields, int num_fields, size_t total, const Viewport *view,
+                              int width, int height, int threads, double *value, uint8_t *state)
+{
+    Mesh mesh = {0};
+    int32_t n = (int32_t)total;
+    mesh.num_points = n + 3;
+    mesh.capacity = 2 * n + 16;
+    mesh.scratch_capacity = 1 << 16;
+    mesh.points = malloc(sizeof(MeshPoint) * mesh.num_points);
+    mesh.triangles = malloc(sizeof(MeshTriangle) * mesh.capacity);
+    mesh.free_list = malloc(sizeof(int32_t) * mesh.capacity);
+    mesh.stack = malloc(sizeof(int32_t) * mesh.scratch_capacity);
+    mesh.cavity = malloc(sizeof(int32_t) * mesh.scratch_capacity);
+    double *px = malloc(sizeof(double) * n * 3);
+    SortKey *order = malloc(sizeof(SortKey) * n);
+    bool ok = mesh.points && mesh.triangles && mesh.free_list && mesh.stack && mesh.cavity && px && order;
+    if (!ok)
+    {
+        perror("Failed to allocate the mesh");
+    }
+
+    // Delaunay is not invariant under the axes' unequal scaling: triangulate in
+    // data units, one scale for both axes, and sample in pixels
+    double *py = px + n, *pv = px + 2 * (size_t)n;
+    double span_x = (view->ax1 + 1 - view->ax0) / view->sx, span_y = (view->ay1 + 1 - view->ay0) / view->sy;
+    double scale = (MESH_GRID - 1) / (span_x > span_y ? span_x : span_y);
+    int32_t i = 0;
+    for (int f = 0; ok && f < num_fields; f++)
+    {
+        for (size_t k = 0; k < fields[f].count; k++, i++)
+        {
+            double x = fields[f].r[k] - view->x0, y = fields[f].z[k] - view->y0;
+            px[i] = view->px0 + x * view->sx;
+            py[i] = height - (view->py0 + y * view->sy);
+            pv[i] = fields[f].value[k];
+            mesh.points[i] = (MeshPoint){llround(x * scale), llround(y * scale)};
+            order[i] = (SortKey){hilbert_index((uint32_t)mesh.points[i].x >> 4, (uint32_t)mesh.points[i].y >> 4), i};
+        }
+    }
+    if (ok)
+    {
+        qsort(order, n, sizeof(SortKey), compare_sort_key);
+        mesh.points[n] = (MeshPoint){-MESH_FAR, -MESH_FAR};
+        mesh.points[n + 1] = (MeshPoint){MESH_FAR, -MESH_FAR};
+        mesh.points[n + 2] = (MeshPoint){0, MESH_FAR};
+        int32_t last = new_triangle(&mesh, n, n + 1, n + 2);
+        for (int32_t k = 0; ok && k < n; k++)
+        {
+            ok = insert_point(&mesh, order[k].index, &last);
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "Blob detection: triangulation failed, averaging per pixel\n");
+        }
+    }
+    if (ok)
+    {
+        // dead triangles sit on the free list, flag them for the raster pass
+        for (int32_t k = 0; k < mesh.num_free; k++)
+        {
+            mesh.triangles[mesh.free_list[k]].stamp = UINT32_MAX;
+        }
+        int parts = threads < 1 ? 1 : threads;
+        TriangleRaster tasks[BLOB_MAX_THREADS];
+        int rows = view->ay1 + 1 - view->ay0;
+        for (int k = 0; k < parts; k++)
+        {
+            tasks[k] = (TriangleRaster){&mesh, px, py, pv, value, state, width,
+                                        view->ay0 + rows * k / parts, view->ay0 + rows * (k + 1) / parts,
+                                        view->ax0, view->ax1 + 1};
+        }
+        run_parallel(raster_triangles, tasks, sizeof(TriangleRaster), parts);
+    }
+    free(order);
+    free(px);
+    free(mesh.points);
+    free(mesh.triangles);
+    free(mesh.free_list);
+    free(mesh.stack);
+    free(mesh.cavity);
+    return ok;
+}
+
+// Draw the field the way tricontourf does into rgb (width * height * 3, RGB)
+bool blob_render(const BlobField *fields, int num_fields, const BlobParams *params, uint8_t *rgb)
+{
+    int width = params->width, height = params->height;
+    size_t pixels = (size_t)width * height;
+    memset(rgb, 255, pixels * 3);
+    if (params->levels < 2 || params->levels > BLOB_LEVELS * 4)
+    {
+        fprintf(stderr, "Blob detection: %d contour levels are not supported\n", params->levels);
+        return false;
+    }
+
+    int threads = params->threads < 1 ? 1 : params->threads > BLOB_MAX_THREADS ? BLOB_MAX_THREADS
+                                                                               : params->threads;
+    int parts = threads > BLOB_RASTER_THREADS ? BLOB_RASTER_THREADS : threads;
+    RasterTask tasks[BLOB_MAX_THREADS];
+    for (int i = 0; i < parts; i++)
+    {
+        tasks[i] = (RasterTask){.fields = fields, .num_fields = num_fields, .part = i, .parts = parts, .width = width, .height = height};
+    }
+    run_parallel(find_extents, tasks, sizeof(RasterTask), parts);
+    double min_value = DBL_MAX, max_value = -DBL_MAX;
+    double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+    for (int i = 0; i < parts; i++)
+    {
+        min_value = fmin(min_value, tasks[i].min_value);
+        max_value = fmax(max_value, tasks[i].max_value);
+        min_x = fmin(min_x, tasks[i].min_x);
+        max_x = fmax(max_x, tasks[i].max_x);
+        min_y = fmin(min_y, tasks[i].min_y);
+        max_y = fmax(max_y, tasks[i].max_y);
+    }
+    if (min_x >= max_x || min_y >= max_y || !(min_value < max_value))
+    {
+        fprintf(stderr, "Blob detection: the field has no extent\n");
+        return false;
+    }
+
+    // contourf pins the axes to the data limits, so margins do not apply
+    Viewport view;
+    view.x0 = min_x;
+    view.y0 = min_y;
+    view.px0 = params->left * width;
+    view.py0 = params->bottom * height;
+    view.sx = (params->right - params->left) * width / (max_x - min_x);
+    view.sy = (params->top - params->bottom) * height / (max_y - min_y);
+    view.ax0 = (int)lround(params->left * width);
+    view.ax1 = (int)lround(params->right * width) - 1;
+    view.ay0 = height - (int)lround(params->top * height);
+    view.ay1 = height - (int)lround(params->bottom * height) - 1;
+
+    // Per-thread accumulators, merged below
+    size_t per_task = pixels * (sizeof(double) + sizeof(uint32_t)) + (size_t)(width + height) * 4 * sizeof(double);
+    char *scratch = malloc(per_task * parts);
+    if (scratch == NULL)
+    {
+        perror("Failed to allocate render buffers");
+        return false;
+    }
+    for (int i = 0; i < parts; i++)
+    {
+        char *base = scratch + per_task * i;
+        RasterTask *task = &tasks[i];
+        task->view = &view;
+        task->sum = (double *)base;
+        task->count = (uint32_t *)(base + pixels * sizeof(double));
+        double *extremes = (double *)(base + pixels * (sizeof(double) + sizeof(uint32_t)));
+        task->col_low = extremes;
+        task->col_high = extremes + width;
+        task->col_low_x = extremes + 2 * width;
+        task->col_high_x = extremes + 3 * width;
+        task->row_left = extremes + 4 * width;
+        task->row_right = extremes + 4 * width + height;
+        task->row_left_y = extremes + 4 * width + 2 * height;
+        task->row_right_y = extremes + 4 * width + 3 * height;
+        memset(task->sum, 0, pixels * sizeof(double));
+        memset(task->count, 0, pixels * sizeof(uint32_t));
+        for (int c = 0; c < width; c++)
+        {
+            task->col_low[c] = DBL_MAX;
+            task->col_high[c] = -DBL_MAX;
+        }
+        for (int r = 0; r < height; r++)
+        {
+            task->row_left[r] = DBL_MAX;
+            task->row_right[r] = -DBL_MAX;
+        }
+    }
+    run_parallel(bin_points, tasks, sizeof(RasterTask), parts);
+
+    double *value = tasks[0].sum;
+    uint32_t *count = tasks[0].count;
+    for (int i = 1; i < parts; i++)
+    {
+        for (size_t pixel = 0; pixel < pixels; pixel++)
+        {
+            value[pixel] += tasks[i].sum[pixel];
+            count[pixel] += tasks[i].count[pixel];
+        }
+    }
+
+    // Mesh outline: tricontourf covers the Delaunay triangulation, whose outline
+    // is the convex hull. Every task adds up to 2 * (width + height) extremes to
+    // the hull so far, which has no more vertices than that itself.
+    int max_candidates = 4 * (width + height);
+    Point2 *candidates = malloc(sizeof(Point2) * max_candidates);
+    Point2 *hull = malloc(sizeof(Point2) * 2 * max_candidates);
+    uint8_t *state = malloc(pixels);
+    if (candidates == NULL || hull == NULL || state == NULL)
+    {
+        perror("Failed to allocate render buffers");
+        free(candidates);
+        free(hull);
+        free(state);
+        free(scratch);
+        return false;
+    }
+    int n = 0;
+    for (int i = 0; i < parts; i++)
+    {
+        for (int c = 0; c < width; c++)
+        {
+            if (tasks[i].col_low[c] != DBL_MAX)
+            {
+                candidates[n++] = (Point2){tasks[i].col_low_x[c], tasks[i].col_low[c]};
+                candidates[n++] = (Point2){tasks[i].col_high_x[c], tasks[i].col_high[c]};
+            }
+        }
+        for (int r = 0; r < height; r++)
+        {
+            if (tasks[i].row_left[r] != DBL_MAX)
+            {
+                candidates[n++] = (Point2){tasks[i].row_left[r], tasks[i].row_left_y[r]};
+                candidates[n++] = (Point2){tasks[i].row_right[r], tasks[i].row_right_y[r]};
+            }
+        }
+        // keep the candidate list bounded by folding it into a hull per task
+        n = convex_hull2(candidates, n, hull);
+        memcpy(candidates, hull, sizeof(Point2) * n);
+    }
+    int hull_size = n;
+
+    memset(state, 0, pixels);
+    for (int row = view.ay0; row <= view.ay1; row++)
+    {
+        double y = view.y0 + (height - row - 0.5 - view.py0) / view.sy;
+        for (int col = view.ax0; col <= view.ax1; col++)
+        {
+            size_t pixel = (size_t)row * width + col;
+            if (count[pixel] > 0)
+            {
+                value[pixel] /= count[pixel];
+                state[pixel] = 2;
+                continue;
+            }
+            Point2 centre = {view.x0 + (col + 0.5 - view.px0) / view.sx, y};
+            bool inside = hull_size >= 3;
+            for (int k = 0; k < hull_size && inside; k++)
+            {
+                inside = cross2(hull[k], hull[(k + 1) % hull_size], centre) >= 0;
+            }
+            state[pixel] = inside ? 1 : 0;
+        }
+    }
+    free(candidates);
+    free(hull);
+    size_t total = 0;
+    for (int f = 0; f < num_fields; f++)
+    {
+        total += fields[f].count;
+    }
+    if (total <= params->triangulate_points && total < INT32_MAX / 2)
+    {
+        interpolate_field(fields, num_fields, total, &view, width, height, threads, value, state);
+    }
+    fill_gaps(value, state, width, height, &view);
+
+    // Levels as np.linspace makes them. Band k covers (level k, level k + 1],
+    // the lowest one includes the minimum, and is painted with the colour of
+    // its middle value; the float steps are matplotlib's, so a middle value
+    // landing on a colormap entry boundary picks the same entry
+    int bands = params->levels - 1;
+    double levels[BLOB_LEVELS * 4];
+    uint8_t band_rgb[BLOB_LEVELS * 4][3];
+    double step = (max_value - min_value) / bands;
+    for (int k = 0; k < bands; k++)
+    {
+        levels[k] = k * step + min_value;
+    }
+    levels[bands] = max_value;
+    for (int k = 0; k < bands; k++)
+    {
+        double layer = 0.5 * (levels[k] + levels[k + 1]);
+        double t = (layer - min_value) / (max_value - min_value) * JET_LUT_SIZE;
+        int index = t >= JET_LUT_SIZE ? JET_LUT_SIZE - 1 : (int)t;
+        jet_rgb(index, band_rgb[k]);
+    }
+    for (size_t pixel = 0; pixel < pixels; pixel++)
+    {
+        if (state[pixel] != 2)
+        {
+            continue;
+        }
+        double v = value[pixel];
+        int band = (int)ceil((v - min_value) / step) - 1;
+        band = band < 0 ? 0 : band >= bands ? bands - 1
+                                            : band;
+        // settle the rounding of the division against the levels themselves
+        if (band > 0 && v <= levels[band])
+        {
+            band--;
+        }
+        else if (band < bands - 1 && v > levels[band + 1])
+        {
+            band++;
+        }
+        memcpy(rgb + pixel * 3, band_rgb[band], 3);
+    }
+    free(state);
+    free(scratch);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Detection, a port of cv::SimpleBlobDetector with the scripts' filters
+
+typedef struct
+{
+    double x, y;
+    double radius;
+    double confidence;
+} BlobCenter;
+
+typedef struct
+{
+    BlobCenter *items;
+    int count;
+    int capacity;
+} CenterList;
+
+typedef struct
+{
+    int x, y;
+} PixelPoint;
+
+typedef struct
+{
+    const uint8_t *gray;
+    const BlobParams *params;
+    double threshold;
+    int32_t *labels; // padded copy of the binary image, Suzuki's border marks
+    PixelPoint *contour;
+    size_t contour_capacity;
+    PixelPoint *hull;
+    CenterList centers;
+} ThresholdPass;
+
+// Neighbour offsets, counter-clockwise from east on an image with y down
+static const int neighbour_dx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int neighbour_dy[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+
+static int direction_of(int dx, int dy)
+{
+    for (int d = 0; d < 8; d++)
+    {
+        if (neighbour_dx[d] == dx && neighbour_dy[d] == dy)
+        {
+            return d;
+        }
+    }
+    return 0;
+}
+
+static bool push_contour_point(ThresholdPass *pass, size_t *n, int x, int y)
+{
+    if (*n == pass->contour_capacity)
+    {
+        size_t capacity = pass->contour_capacity * 2;
+        PixelPoint *grown = realloc(pass->contour, capacity * sizeof(PixelPoint));
+        PixelPoint *hull = realloc(pass->hull, 2 * capacity * sizeof(PixelPoint));
+        if (grown != NULL)
+        {
+            pass->contour = grown;
+        }
+        if (hull != NULL)
+        {
+            pass->hull = hull;
+        }
+        if (grown == NULL || hull == NULL)
+        {
+            return false;
+        }
+        pass->contour_capacity = capacity;
+    }
+    pass->contour[(*n)++] = (PixelPoint){x, y};
+    return true;
+}
+
+// Suzuki-Abe border following from (x, y), entered from neighbour (from_x, from_y).
+// Points are in the padded frame, every visited pixel is kept (CHAIN_APPROX_NONE).
+static size_t follow_border(ThresholdPass *pass, int stride, int x, int y, int from_x, int from_y, int32_t nbd)
+{
+    int32_t *f = pass->labels;
+    size_t n = 0;
+
+    // Clockwise around the start for its first non-zero neighbour
+    int start = direction_of(from_x - x, from_y - y);
+    int found = -1;
+    for (int k = 0; k < 8; k++)
+    {
+        int d = (start - k + 8) & 7;
+        if (f[(y + neighbour_dy[d]) * stride + x + neighbour_dx[d]] != 0)
+        {
+            found = d;
+            break;
+        }
+    }
+    if (found < 0)
+    {
+        f[y * stride + x] = -nbd;
+        push_contour_point(pass, &n, x, y);
+        return n;
+    }
+
+    int x1 = x + neighbour_dx[found], y1 = y + neighbour_dy[found];
+    int x2 = x1, y2 = y1, x3 = x, y3 = y;
+    while (true)
+    {
+        // Counter-clockwise around (x3, y3), starting after (x2, y2)
+        int from = direction_of(x2 - x3, y2 - y3);
+        bool east_examined = false;
+        int x4 = x3, y4 = y3;
+        for (int k = 1; k <= 8; k++)
+        {
+            int d = (from + k) & 7;
+            int nx = x3 + neighbour_dx[d], ny = y3 + neighbour_dy[d];
+            if (f[ny * stride + nx] != 0)
+            {
+                x4 = nx;
+                y4 = ny;
+                break;
+            }
+            if (d == 0)
+            {
+                east_examined = true;
+            }
+        }
+        int32_t *mark = &f[y3 * stride + x3];
+        if (east_examined)
+        {
+            *mark = -nbd;
+        }
+        else if (*mark == 1)
+        {
+            *mark = nbd;
+        }
+        if (!push_contour_point(pass, &n, x3, y3))
+        {
+            return n;
+        }
+        if (x4 == x && y4 == y && x3 == x1 && y3 == y1)
+        {
+            return n;
+        }
+        x2 = x3;
+        y2 = y3;
+        x3 = x4;
+        y3 = y4;
+    }
+}
+
+typedef struct
+{
+    double m00, m10, m01, m20, m11, m02;
+} ContourMoments;
+
+// Polygon moments by Green's theorem, normalised to a positive area like cv::moments
+static ContourMoments contour_moments(const PixelPoint *points, size_t n)
+{
+    double a00 = 0, a10 = 0, a01 = 0, a20 = 0, a11 = 0, a02 = 0;
+    double xi_1 = points[n - 1].x, yi_1 = points[n - 1].y;
+    double xi_12 = xi_1 * xi_1, yi_12 = yi_1 * yi_1;
+    for (size_t i = 0; i < n; i++)
+    {
+        double xi = points[i].x, yi = points[i].y;
+        double xi2 = xi * xi, yi2 = yi * yi;
+        double dxy = xi_1 * yi - xi * yi_1;
+        double xii_1 = xi_1 + xi, yii_1 = yi_1 + yi;
+        a00 += dxy;
+        a10 += dxy * xii_1;
+        a01 += dxy * yii_1;
+        a20 += dxy * (xi_1 * xii_1 + xi2);
+        a11 += dxy * (xi_1 * (yii_1 + yi_1) + xi * (yii_1 + yi));
+        a02 += dxy * (yi_1 * yii_1 + yi2);
+        xi_1 = xi;
+        yi_1 = yi;
+        xi_12 = xi2;
+        yi_12 = yi2;
+    }
+    (void)xi_12;
+    (void)yi_12;
+    ContourMoments m = {0};
+    if (fabs(a00) > FLT_EPSILON)
+    {
+        double sign = a00 > 0 ? 1.0 : -1.0;
+        m.m00 = sign * a00 / 2;
+        m.m10 = sign * a10 / 6;
+        m.m01 = sign * a01 / 6;
+        m.m20 = sign * a20 / 12;
+        m.m11 = sign * a11 / 24;
+        m.m02 = sign * a02 / 12;
+    }
+    return m;
+}
+
+static long cross_pixel(PixelPoint o, PixelPoint a, PixelPoint b)
+{
+    return (long)(a.x - o.x) * (b.y - o.y) - (long)(a.y - o.y) * (b.x - o.x);
+}
+
+static int compare_pixel(const void *a, const void *b)
+{
+    const PixelPoint *p = a, *q = b;
+    return p->x != q->x ? p->x - q->x : p->y - q->y;
+}
+
+static double polygon_area(const PixelPoint *points, int n)
+{
+    double area = 0.0;
+    for (int i = 0, j = n - 1; i < n; j = i++)
+    {
+        area += (double)points[j].x * points[i].y - (double)points[j].y * points[i].x;
+    }
+    return fabs(area) / 2;
+}
+
+// Area of the convex hull; sorts the contour in place, measure it last
+static double hull_area(ThresholdPass *pass, size_t n)
+{
+    PixelPoint *sorted = pass->contour;
+    PixelPoint *chain = pass->hull;
+    qsort(sorted, n, sizeof(PixelPoint), compare_pixel);
+    int k = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        while (k >= 2 && cross_pixel(chain[k - 2], chain[k - 1], sorted[i]) <= 0)
+        {
+            k--;
+        }
+        chain[k++] = sorted[i];
+    }
+    for (long i = (long)n - 2, lower = k + 1; i >= 0; i--)
+    {
+        while (k >= lower && cross_pixel(chain[k - 2], chain[k - 1], sorted[i]) <= 0)
+        {
+            k--;
+        }
+        chain[k++] = sorted[i];
+    }
+    return polygon_area(chain, n > 1 ? k - 1 : (int)n);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool push_center(CenterList *list, BlobCenter center)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        BlobCenter *grown = realloc(list->items, capacity * sizeof(BlobCenter));
+        if (grown == NULL)
+        {
+            return false;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = center;
+    return true;
+}
+
+// Filters one contour and records its centre (findBlobs)
+static void evaluate_contour(ThresholdPass *pass, size_t n, int width, int height)
+{
+    const BlobParams *params = pass->params;
+    // back to image coordinates
+    for (size_t i = 0; i < n; i++)
+    {
+        pass->contour[i].x--;
+        pass->contour[i].y--;
+    }
+    ContourMoments m = contour_moments(pass->contour, n);
+    if (m.m00 < params->min_area || m.m00 >= params->max_area)
+    {
+        return;
+    }
+
+    BlobCenter center = {.confidence = 1.0};
+    double cx = m.m00 != 0 ? m.m10 / m.m00 : 0, cy = m.m00 != 0 ? m.m01 / m.m00 : 0;
+    double mu20 = m.m20 - m.m10 * cx, mu11 = m.m11 - m.m10 * cy, mu02 = m.m02 - m.m01 * cy;
+    double denominator = sqrt((2 * mu11) * (2 * mu11) + (mu20 - mu02) * (mu20 - mu02));
+    const double eps = 1e-2;
+    double ratio;
+    if (denominator > eps)
+    {
+        double cosmin = (mu20 - mu02) / denominator;
+        double sinmin = 2 * mu11 / denominator;
+        double cosmax = -cosmin;
+        double sinmax = -sinmin;
+        double imin = 0.5 * (mu20 + mu02) - 0.5 * (mu20 - mu02) * cosmin - mu11 * sinmin;
+        double imax = 0.5 * (mu20 + mu02) - 0.5 * (mu20 - mu02) * cosmax - mu11 * sinmax;
+        ratio = imin / imax;
+    }
+    else
+    {
+        ratio = 1;
+    }
+    if (ratio < params->min_inertia_ratio)
+    {
+        return;
+    }
+    center.confidence = ratio * ratio;
+
+    double area = polygon_area(pass->contour, (int)n);
+    // distances need the contour in order, measure them before the hull sorts it
+    double *distances = malloc(n * sizeof(double));
+    if (distances == NULL)
+    {
+        return;
+    }
+    center.x = cx;
+    center.y = cy;
+    for (size_t i = 0; i < n; i++)
+    {
+        distances[i] = hypot(cx - pass->contour[i].x, cy - pass->contour[i].y);
+    }
+    double hull = hull_area(pass, n);
+    if (area / hull < params->min_convexity || m.m00 == 0.0)
+    {
+        free(distances);
+        return;
+    }
+
+    // blobColor 0: the centre has to fall on a dark pixel of the binary image
+    long px = lrint(cx), py = lrint(cy);
+    if (px < 0 || py < 0 || px >= width || py >= height || pass->gray[py * width + px] > pass->threshold)
+    {
+        free(distances);
+        return;
+    }
+
+    qsort(distances, n, sizeof(double), compare_double);
+    center.radius = (distances[(n - 1) / 2] + distances[n / 2]) / 2.;
+    free(distances);
+    push_center(&pass->centers, center);
+}
+
+// Binarise at one threshold and collect the centres of the blobs that pass
+static void *threshold_pass(void *arg)
+{
+    ThresholdPass *pass = arg;
+    const BlobParams *params = pass->params;
+    int width = params->width, height = params->height;
+    int stride = width + 2;
+    int32_t *f = pass->labels;
+    memset(f, 0, sizeof(int32_t) * stride * (height + 2));
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *src = pass->gray + (size_t)y * width;
+        int32_t *dst = f + (size_t)(y + 1) * stride + 1;
+        for (int x = 0; x < width; x++)
+        {
+            dst[x] = src[x] > pass->threshold;
+        }
+    }
+
+    int32_t nbd = 1;
+    for (int y = 1; y <= height; y++)
+    {
+        for (int x = 1; x <= width; x++)
+        {
+            int32_t value = f[y * stride + x];
+            size_t n = 0;
+            if (value == 1 && f[y * stride + x - 1] == 0)
+            {
+                n = follow_border(pass, stride, x, y, x - 1, y, ++nbd);
+            }
+            else if (value >= 1 && f[y * stride + x + 1] == 0)
+            {
+                n = follow_border(pass, stride, x, y, x + 1, y, ++nbd);
+            }
+            if (n > 0)
+            {
+                evaluate_contour(pass, n, width, height);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Gray image the scripts hand to the detector: red-masked BGR -> gray
+static void masked_gray(const uint8_t *rgb, size_t pixels, uint8_t *gray)
+{
+    for (size_t i = 0; i < pixels; i++)
+    {
+        int r = rgb[i * 3], g = rgb[i * 3 + 1], b = rgb[i * 3 + 2];
+        bool keep = b >= mask_lower[0] && b <= mask_upper[0] &&
+                    g >= mask_lower[1] && g <= mask_upper[1] &&
+                    r >= mask_lower[2] && r <= mask_upper[2];
+        int luma = (r * 4899 + g * 9617 + b * 1868 + 8192) >> 14;
+        gray[i] = keep ? (uint8_t)luma : 0;
+    }
+}
+
+bool blob_detect(const uint8_t *rgb, const BlobParams *params, BlobResult *result)
+{
+    memset(result, 0, sizeof(*result));
+    int width = params->width, height = params->height;
+    size_t pixels = (size_t)width * height;
+    uint8_t *gray = malloc(pixels);
+    if (gray == NULL)
+    {
+        perror("Failed to allocate the gray image");
+        return false;
+    }
+    masked_gray(rgb, pixels, gray);
+
+    int num_passes = 0;
+    for (double t = params->min_threshold; t < params->max_threshold; t += params->threshold_step)
+    {
+        num_passes++;
+    }
+    ThresholdPass *passes = calloc(num_passes, sizeof(ThresholdPass));
+    size_t label_size = sizeof(int32_t) * (width + 2) * (height + 2);
+    bool ok = passes != NULL;
+    double threshold = params->min_threshold;
+    for (int i = 0; ok && i < num_passes; i++, threshold += params->threshold_step)
+    {
+        ThresholdPass *pass = &passes[i];
+        pass->gray = gray;
+        pass->params = params;
+        pass->threshold = threshold;
+        pass->contour_capacity = 4096;
+        pass->labels = malloc(label_size);
+        pass->contour = malloc(pass->contour_capacity * sizeof(PixelPoint));
+        pass->hull = malloc(2 * pass->contour_capacity * sizeof(PixelPoint));
+        ok = pass->labels != NULL && pass->contour != NULL && pass->hull != NULL;
+    }
+    if (!ok)
+    {
+        perror("Failed to allocate blob detection buffers");
+    }
+
+    // Thresholds are independent, run them in batches of params->threads
+    int threads = params->threads < 1 ? 1 : params->threads > BLOB_MAX_THREADS ? BLOB_MAX_THREADS
+                                                                               : params->threads;
+    for (int i = 0; ok && i < num_passes; i += threads)
+    {
+        int batch = num_passes - i < threads ? num_passes - i : threads;
+        run_parallel(threshold_pass, &passes[i], sizeof(ThresholdPass), batch);
+    }
+
+    // Group centres across thresholds in threshold order, as detect() does
+    CenterList *groups = NULL;
+    int num_groups = 0, group_capacity = 0;
+    for (int i = 0; ok && i < num_passes; i++)
+    {
+        const CenterList *current = &passes[i].centers;
+        int known_groups = num_groups;
+        // findContours lists contours last found first, and the order decides
+        // which group a centre joins
+        for (int c = current->count - 1; c >= 0; c--)
+        {
+            const BlobCenter *center = &current->items[c];
+            bool is_new = true;
+            for (int g = 0; g < known_groups; g++)
+            {
+                CenterList *group = &groups[g];
+                const BlobCenter *middle = &group->items[group->count / 2];
+                double dist = hypot(middle->x - center->x, middle->y - center->y);
+                is_new = dist >= params->min_dist_between_blobs && dist >= middle->radius && dist >= center->radius;
+                if (!is_new)
+                {
+                    push_center(group, *center);
+                    // keep the group sorted by radius
+                    int k = group->count - 1;
+                    while (k > 0 && group->items[k].radius < group->items[k - 1].radius)
+                    {
+                        BlobCenter swap = group->items[k];
+                        group->items[k] = group->items[k - 1];
+                        group->items[k - 1] = swap;
+                        k--;
+                    }
+                    break;
+                }
+            }
+            if (is_new)
+            {
+                if (num_groups == group_capacity)
+                {
+                    group_capacity = group_capacity ? group_capacity * 2 : 64;
+                    CenterList *grown = realloc(groups, group_capacity * sizeof(CenterList));
+                    if (grown == NULL)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    groups = grown;
+                }
+                groups[num_groups] = (CenterList){0};
+                push_center(&groups[num_groups++], *center);
+            }
+        }
+    }
+
+    result->keypoints = malloc(sizeof(BlobKeypoint) * (num_groups > 0 ? num_groups : 1));
+    for (int g = 0; ok && g < num_groups; g++)
+    {
+        const CenterList *group = &groups[g];
+        if (group->count < params->min_repeatability)
+        {
+            continue;
+        }
+        double x = 0, y = 0, normalizer = 0;
+        for (int k = 0; k < group->count; k++)
+        {
+            x += group->items[k].confidence * group->items[k].x;
+            y += group->items[k].confidence * group->items[k].y;
+            normalizer += group->items[k].confidence;
+        }
+        BlobKeypoint *keypoint = &result->keypoints[result->count++];
+        keypoint->x = x / normalizer;
+        keypoint->y = y / normalizer;
+        // cv::KeyPoint keeps the size as a float
+        keypoint->size = (float)group->items[group->count / 2].radius * 2.0f;
+    }
+
+    // Summary the scripts print; a blob always overlaps itself in combine.py's loop
+    double total_diameter = 0, overlap = 0;
+    for (int k = 0; k < result->count; k++)
+    {
+        const BlobKeypoint *a = &result->keypoints[k];
+        total_diameter += a->size;
+        result->total_area += 3.14 * pow(a->size / 2, 2);
+        for (int p = 0; p < result->count; p++)
+        {
+            const BlobKeypoint *b = &result->keypoints[p];
+            if (hypot(a->x - b->x, a->y - b->y) < (a->size + b->size) / 2.0)
+            {
+                overlap += 1.0;
+                break;
+            }
+        }
+    }
+    if (result->count > 0)
+    {
+        result->avg_diameter = total_diameter / result->count;
+        result->overlap_ratio = overlap / result->count;
+    }
+
+    for (int g = 0; g < num_groups; g++)
+    {
+        free(groups[g].items);
+    }
+    free(groups);
+    for (int i = 0; passes != NULL && i < num_passes; i++)
+    {
+        free(passes[i].labels);
+        free(passes[i].contour);
+        free(passes[i].hull);
+        free(passes[i].centers.items);
+    }
+    free(passes);
+    free(gray);
+    return ok;
+}
+
+bool blob_analyse(const BlobField *fields, int num_fields, const BlobParams *params, BlobResult *result)
+{
+    uint8_t *rgb = malloc((size_t)params->width * params->height * 3);
+    if (rgb == NULL)
+    {
+        perror("Failed to allocate the image");
+        return false;
+    }
+    bool ok = blob_render(fields, num_fields, params, rgb) && blob_detect(rgb, params, result);
+    free(rgb);
+    return ok;
+}
+
+void blob_result_free(BlobResult *result)
+{
+    free(result->keypoints);
+    result->keypoints = NULL;
+    result->count = 0;
+}
+
+// Rendered image for inspection, binary PPM
+bool blob_write_ppm(const char *path, const uint8_t *rgb, int width, int height)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        perror("Failed to open image file");
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool ok = fwrite(rgb, 3, (size_t)width * height, file) == (size_t)width * height;
+    fclose(file);
+    return ok;
+}
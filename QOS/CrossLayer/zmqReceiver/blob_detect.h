@@ -0,0 +1,82 @@
+#ifndef BLOB_DETECT_H
+#define BLOB_DETECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Native version of scripts/data_to_blob_detection.py and scripts/combine.py:
+// the (r, z, value) field is drawn into the image those scripts save with
+// tricontourf (8x8 in at 100 dpi, jet colormap, 25 levels), then the red mask
+// and SimpleBlobDetector run on it in memory.
+
+#define BLOB_IMAGE_SIZE 800
+#define BLOB_LEVELS 25
+#define BLOB_MAX_THREADS 32
+
+// Fields up to this many nodes are triangulated and interpolated like
+// tricontourf; denser ones are averaged per pixel, which agrees once every
+// pixel holds a few nodes and is much cheaper
+#ifndef BLOB_TRIANGULATE_POINTS
+#define BLOB_TRIANGULATE_POINTS 1000000
+#endif
+
+typedef enum
+{
+    BLOB_LAYOUT_FILL,   // combine.py: the axes cover the whole figure
+    BLOB_LAYOUT_SUBPLOT // data_to_blob_detection.py: matplotlib's default subplot box
+} BlobLayout;
+
+// One block of mesh nodes, several blocks are drawn as one field (reduced + delta)
+typedef struct
+{
+    const double *value;
+    const double *r;
+    const double *z;
+    size_t count;
+} BlobField;
+
+typedef struct
+{
+    int width;
+    int height;
+    double left, right, bottom, top; // axes box as fractions of the figure
+    int levels;
+    size_t triangulate_points;
+    // cv2.SimpleBlobDetector_Params as the scripts set them
+    double min_threshold;
+    double max_threshold;
+    double threshold_step;
+    int min_repeatability;
+    double min_dist_between_blobs;
+    double min_area;
+    double max_area;
+    double min_convexity;
+    double min_inertia_ratio;
+    int threads;
+} BlobParams;
+
+typedef struct
+{
+    double x;
+    double y;
+    double size; // diameter in pixels
+} BlobKeypoint;
+
+typedef struct
+{
+    int count;
+    double avg_diameter;
+    double total_area; // sum of 3.14 * (size / 2)^2, as the scripts compute it
+    double overlap_ratio;
+    BlobKeypoint *keypoints;
+} BlobResult;
+
+void blob_params_init(BlobParams *params, BlobLayout layout, double min_convexity);
+bool blob_render(const BlobField *fields, int num_fields, const BlobParams *params, uint8_t *rgb);
+bool blob_detect(const uint8_t *rgb, const BlobParams *params, BlobResult *result);
+bool blob_analyse(const BlobField *fields, int num_fields, const BlobParams *params, BlobResult *result);
+void blob_result_free(BlobResult *result);
+bool blob_write_ppm(const char *path, const uint8_t *rgb, int width, int height);
+
+#endif // BLOB_DETECT_H
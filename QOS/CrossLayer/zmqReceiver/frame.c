@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "frame.h"
+
+uint64_t frame_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void frame_init(FrameHeader *header, FrameType type, int stream, int step)
+{
+    memset(header, 0, sizeof(FrameHeader));
+    header->magic = FRAME_MAGIC;
+    header->version = FRAME_VERSION;
+    header->type = (uint8_t)type;
+    header->stream = (uint16_t)stream;
+    header->step = (uint32_t)step;
+}
+
+// Send the header, then payload as the second frame when there is one. The
+// payload message is consumed either way. send_ns is stamped here.
+bool frame_send(void *socket, FrameHeader *header, zmq_msg_t *payload, int flags)
+{
+    header->send_ns = frame_clock_ns();
+    bool sent = zmq_send(socket, header, sizeof(FrameHeader), (payload != NULL) ? (flags | ZMQ_SNDMORE) : flags) == sizeof(FrameHeader);
+    if (payload == NULL)
+    {
+        return sent;
+    }
+    // A header that was not queued starts no message, sending the payload
+    // would make it a message of its own
+    if (sent && zmq_msg_send(payload, socket, flags) < 0)
+    {
+        sent = false;
+    }
+    zmq_msg_close(payload);
+    return sent;
+}
+
+// Send a payload that is copied into the message
+bool frame_send_bytes(void *socket, FrameHeader *header, const void *data, size_t size)
+{
+    zmq_msg_t payload;
+    zmq_msg_init_size(&payload, size);
+    memcpy(zmq_msg_data(&payload), data, size);
+    return frame_send(socket, header, &payload, 0);
+}
+
+// Receive one message. payload is always initialized and left empty when the
+// message is a bare header. Returns false when nothing arrived (ZMQ_DONTWAIT or
+// an error); a message that is not a frame of this protocol version is dropped
+// and returned with header type 0.
+bool frame_recv(void *socket, FrameHeader *header, zmq_msg_t *payload, int flags)
+{
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    zmq_msg_init(payload);
+    if (zmq_msg_recv(&msg, socket, flags) < 0)
+    {
+        zmq_msg_close(&msg);
+        return false;
+    }
+    bool more = zmq_msg_more(&msg);
+    bool valid = zmq_msg_size(&msg) == sizeof(FrameHeader);
+    if (valid)
+    {
+        memcpy(header, zmq_msg_data(&msg), sizeof(FrameHeader));
+        valid = header->magic == FRAME_MAGIC && header->version == FRAME_VERSION;
+    }
+    zmq_msg_close(&msg);
+    // Drain the rest of the message, only the first extra frame is kept
+    for (int frame = 1; more; frame++)
+    {
+        zmq_msg_t extra;
+        zmq_msg_t *target = (frame == 1) ? payload : &extra;
+        if (target == &extra)
+        {
+            zmq_msg_init(&extra);
+        }
+        zmq_msg_recv(target, socket, 0);
+        more = zmq_msg_more(target);
+        if (target == &extra)
+        {
+            zmq_msg_close(&extra);
+        }
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "Dropping a message that is not a version %d frame\n", FRAME_VERSION);
+        memset(header, 0, sizeof(FrameHeader));
+        zmq_msg_close(payload);
+        zmq_msg_init(payload);
+    }
+    return true;
+}
+
+const char *frame_type_name(int type)
+{
+    switch (type)
+    {
+    case FRAME_STEP_BEGIN:
+        return "step_begin";
+    case FRAME_CHUNK:
+        return "chunk";
+    case FRAME_FILE_END:
+        return "file_end";
+    case FRAME_STEP_END:
+        return "step_end";
+    case FRAME_STEP_ACK:
+        return "step_ack";
+    case FRAME_CHUNK_ACK:
+        return "chunk_ack";
+    default:
+        return "unknown";
+    }
+}
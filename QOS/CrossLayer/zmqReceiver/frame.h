@@ -0,0 +1,19 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zmq.h>
+#include "protocol.h"
+
+// Shared by the sender and the receiver, keep both copies identical
+
+uint64_t frame_clock_ns(void);
+void frame_init(FrameHeader *header, FrameType type, int stream, int step);
+bool frame_send(void *socket, FrameHeader *header, zmq_msg_t *payload, int flags);
+bool frame_send_bytes(void *socket, FrameHeader *header, const void *data, size_t size);
+bool frame_recv(void *socket, FrameHeader *header, zmq_msg_t *payload, int flags);
+const char *frame_type_name(int type);
+
+#endif // FRAME_H
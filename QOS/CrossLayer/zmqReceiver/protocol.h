@@ -0,0 +1,73 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+// Wire structures shared by the sender and the receiver.
+// zmqSender/protocol.h and zmqReceiver/protocol.h must stay identical.
+
+// Number of data chunks covered by one cumulative ack
+#define ACK_BATCH 8
+
+// Cumulative ack sent by the receiver after every ACK_BATCH chunks and
+// whenever a FILE_END arrives. Chunks are numbered from 0 per
+// stream and step; the ack covers chunks [acked_through - count, acked_through).
+// Per chunk it reports the arrival minus the send_ns of its header (one-way
+// delay plus the offset between the two clocks) and the delivery interval:
+// the larger of the gaps to the previous chunk's arrival and to its send_ns,
+// 0 for the first chunk of a step. bytes / interval is the delivery rate.
+// echo_send_ns and echo_recv_ns are the stamps of the newest chunk, with the
+// ack's own send_ns they let the sender estimate the clock offset.
+typedef struct
+{
+    uint64_t acked_through;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t echo_send_ns;
+    uint64_t echo_recv_ns;
+    double delay[ACK_BATCH];
+    double interval[ACK_BATCH];
+} ChunkAck;
+
+// Every message starts with a FrameHeader frame; CHUNK, STEP_BEGIN and
+// CHUNK_ACK carry their payload in a second frame. Fields are in host byte
+// order, both ends run on the same architecture.
+#define FRAME_MAGIC 0x5143 // "CQ"
+#define FRAME_VERSION 1
+
+typedef enum
+{
+    FRAME_STEP_BEGIN = 1, // payload: file table of the step, length is the number of files
+    FRAME_CHUNK,          // payload: bytes [offset, offset + length) of file file_id
+    FRAME_FILE_END,       // file_id is complete, offset is the number of bytes sent
+    FRAME_STEP_END,       // every file of the step was sent, FRAME_LAST_STEP on the last one
+    FRAME_STEP_ACK,       // receiver: the step is on disk, length steps of offset are queued for analysis
+    FRAME_CHUNK_ACK       // receiver: payload is a ChunkAck
+} FrameType;
+
+// STEP_END flag: no more steps follow on this stream
+#define FRAME_LAST_STEP 1
+
+typedef struct
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint16_t stream;
+    uint16_t flags;
+    uint32_t step;
+    uint32_t file_id;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t send_ns; // CLOCK_MONOTONIC of the sending host when the frame left
+} FrameHeader;
+
+// STEP_BEGIN payload: uint64_t sizes[length] followed by length NUL-terminated
+// names. file_id is the file's index in the table. A FILE_END offset below the
+// announced size means the file was cut short.
+//
+// Steps of a stream begin in order, but frames of a step that began may
+// interleave with those of the next ones: the receiver keeps the files and
+// acks of each open step apart and routes CHUNK, FILE_END and STEP_END by step.
+
+#endif // PROTOCOL_H
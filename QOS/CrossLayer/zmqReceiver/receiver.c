@@ -9,123 +9,286 @@
 #include <sys/types.h>
 #include <errno.h>
 #include "step_manager.h"
+#include "protocol.h"
+#include "frame.h"
+#include "streams.h"
+#include "chunk_writer.h"
+#include "dir_cache.h"
+#include "analysis_pool.h"
+#include "blob_detect.h"
+#include "step_field.h"
+#include "event_log.h"
 
 #define BASE_PORT 4444
+#define DATA_DIRECTORY "../data"
+
+// Step analysis: 0 off, 1 native blob detection, 2 the Python scripts
+#ifndef BLOB_ANALYSIS
+#define BLOB_ANALYSIS 1
+#endif
+
+// 1: keep the image the native analysis drew, as analysis/<step>/unblobed.ppm
+#ifndef BLOB_SAVE_IMAGE
+#define BLOB_SAVE_IMAGE 0
+#endif
 
 void *context;
 DataQuality shared_data_quality = FULL;
+StreamTable stream_table;
 
-// Function to create directories recursively
-int create_directories(const char *path)
+// Log the bytes the stream received in each window of 2 seconds or more
+void log_time_info(struct timeval *start, double *bytesReceived, int stream_index)
 {
-    char temp[256];
-    char *p = NULL;
-
-    // Copy the path to a temporary buffer
-    snprintf(temp, sizeof(temp), "%s", path);
+    struct timeval end;
+    gettimeofday(&end, NULL);
 
-    // Iterate through each component of the path
-    for (p = temp + 1; *p; p++)
+    // Check if 2 seconds have passed
+    double elapsed = (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1000000.0;
+    if (elapsed >= 2.0)
     {
-        if (*p == '/')
-        {
-            *p = '\0'; // Temporarily terminate the string
-            if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
-            {
-                perror("mkdir");
-                return -1; // Directory creation failed
-            }
-            *p = '/'; // Restore the slash
-        }
+        event_log(EVENT_STREAM_WINDOW, stream_index, -1, elapsed, *bytesReceived);
+        gettimeofday(start, NULL);
+        *bytesReceived = 0.0;
     }
+}
+
+void send_chunk_ack(void *socket, int stream_index, int step, ChunkAck *ack)
+{
+    FrameHeader header;
+    frame_init(&header, FRAME_CHUNK_ACK, stream_index, step);
+    frame_send_bytes(socket, &header, ack, sizeof(ChunkAck));
+    ack->count = 0;
+}
 
-    // Create the final directory
-    if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
+// Unpack the file table of a STEP_BEGIN. Returns the number of files.
+int parse_step_begin(const FrameHeader *header, zmq_msg_t *payload, char ***filenames, uint64_t **file_sizes)
+{
+    int step = (int)header->step;
+    size_t size = zmq_msg_size(payload);
+    const char *table = zmq_msg_data(payload);
+    int num_files = (int)header->length;
+    if (header->length > MAX_STREAM_FILES || size < num_files * sizeof(uint64_t))
     {
-        perror("mkdir");
-        return -1;
+        fprintf(stderr, "Step (%d): malformed file table\n", step);
+        exit(EXIT_FAILURE);
     }
-
-    return 0; // Success
+    *filenames = malloc(num_files * sizeof(char *));
+    *file_sizes = malloc(num_files * sizeof(uint64_t));
+    if ((*filenames == NULL || *file_sizes == NULL) && num_files > 0)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    const char *name = table + num_files * sizeof(uint64_t);
+    const char *end = table + size;
+    for (int j = 0; j < num_files; j++)
+    {
+        size_t length = strnlen(name, end - name);
+        if (name + length == end)
+        {
+            fprintf(stderr, "Step (%d): malformed file table\n", step);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&(*file_sizes)[j], table + j * sizeof(uint64_t), sizeof(uint64_t));
+        (*filenames)[j] = strndup(name, length);
+        name += length + 1;
+    }
+    return num_files;
 }
 
-char *construct_filepath(const char *filename, int step)
+// A step of the stream between its STEP_BEGIN and the end of its last file.
+// Several can be open at once, frames are routed to them by step.
+typedef struct OpenStep
+{
+    int step;
+    StepInfo *info;
+    int file_count;
+    char **filenames;
+    uint64_t *file_sizes;
+    ChunkWriter *writers;
+    int *field_arrays; // the native analysis inputs are also kept in the step's field, -1 for other files
+    bool *finished;    // FILE_END arrived, later frames for the file are dropped
+    int num_read_files;
+    bool ended; // STEP_END arrived
+    bool last;  // and flagged the stream's last step
+    ChunkAck ack;
+    // Send and arrival stamps of the previous chunk of the step
+    uint64_t last_send_ns;
+    uint64_t last_arrival_ns;
+    struct OpenStep *next;
+} OpenStep;
+
+// Register the step a STEP_BEGIN announces and open its files in
+// ../data/<directory>/<step>/, chunks are written at their offsets
+OpenStep *open_step(int stream_index, DataQuality quality, DirCache *directories, const FrameHeader *header,
+                    zmq_msg_t *payload)
 {
-    char *filepath = (char *)malloc(256 * sizeof(char));
-    if (filepath == NULL)
+    const StreamDescriptor *stream = &stream_table.streams[stream_index];
+    OpenStep *open = calloc(1, sizeof(OpenStep));
+    if (open == NULL)
     {
         perror("Failed to allocate memory");
-        return NULL;
+        exit(EXIT_FAILURE);
     }
-
-    char new_directory[256];
-    const char *directory = "../data";
-
-    if (strstr(filename, "reduced") != NULL)
+    open->step = (int)header->step;
+    // Hold off while the analysis is a full queue behind
+    wait_for_analysis_room();
+    open->info = get_or_create_step(open->step, quality);
+    open->file_count = parse_step_begin(header, payload, &open->filenames, &open->file_sizes);
+    int step_dir = dir_cache_get(directories, stream->directory, open->step);
+    if (step_dir < 0)
     {
-        snprintf(new_directory, sizeof(new_directory), "%s/%s/%d/", directory, "reduced", step);
+        exit(EXIT_FAILURE);
     }
-    else if (strstr(filename, "delta") != NULL)
+    int file_count = open->file_count;
+    open->writers = malloc(file_count * sizeof(ChunkWriter));
+    open->field_arrays = malloc(file_count * sizeof(int));
+    open->finished = calloc(file_count, sizeof(bool));
+    if ((open->writers == NULL || open->field_arrays == NULL || open->finished == NULL) && file_count > 0)
     {
-        snprintf(new_directory, sizeof(new_directory), "%s/%s/%d/", directory, "delta", step);
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
     }
-    else
+    for (int i = 0; i < file_count; i++)
     {
-        snprintf(new_directory, sizeof(new_directory), "%s", directory);
+        add_filename(&open->info->filenames[stream_index], open->filenames[i]);
+        if (!chunk_writer_open_sized(&open->writers[i], step_dir, open->filenames[i], open->file_sizes[i]))
+        {
+            exit(EXIT_FAILURE);
+        }
+        open->field_arrays[i] = -1;
+        if (BLOB_ANALYSIS == 1)
+        {
+            open->field_arrays[i] = step_field_reserve(open->info->field, open->filenames[i], open->file_sizes[i]);
+        }
     }
+    return open;
+}
 
-    // Ensure the directory exists
-    if (create_directories(new_directory) != 0)
+void free_open_step(OpenStep *open)
+{
+    for (int i = 0; i < open->file_count; i++)
     {
-        free(filepath);
-        return NULL;
+        free(open->filenames[i]);
     }
+    free(open->filenames);
+    free(open->file_sizes);
+    free(open->writers);
+    free(open->field_arrays);
+    free(open->finished);
+    free(open);
+}
 
-    // Construct the full file path
-    sprintf(filepath, "%s%s", new_directory, filename);
-    return filepath;
+// Every file of the step is on disk: ack it, telling the sender how far the
+// analysis is behind, and hand it to the step processor
+void finish_step(void *socket, int stream_index, OpenStep *open)
+{
+    FrameHeader step_ack;
+    frame_init(&step_ack, FRAME_STEP_ACK, stream_index, open->step);
+    step_ack.length = analysis_backlog();
+    step_ack.offset = ANALYSIS_QUEUE_DEPTH + ANALYSIS_WORKERS;
+    frame_send(socket, &step_ack, NULL, 0);
+    mark_step_complete(open->step, stream_index);
+    free_open_step(open);
 }
 
-void log_time_info(struct timeval *start, double *bytesReceived, int type)
+// The connection failed with the step still open: close what arrived of its files
+void abandon_step(OpenStep *open)
 {
-    struct timeval end;
-    gettimeofday(&end, NULL);
+    for (int i = 0; i < open->file_count; i++)
+    {
+        if (!open->finished[i])
+        {
+            chunk_writer_close(&open->writers[i]);
+        }
+    }
+    free_open_step(open);
+}
 
-    // Check if 2 seconds have passed
-    double elapsed = (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1000000.0;
-    if (elapsed >= 2.0)
+// Blob detection in process on the step's in-memory inputs: the reduced data,
+// plus the delta nodes that arrived when the step is full quality. A cut-short
+// delta stream is drawn up to its shortest file.
+static void run_native_blob_detection(DataQuality data_quality, int step, const StepField *field, AnalysisResult *analysis)
+{
+    BlobField fields[2];
+    int num_fields = 0;
+    BlobField *reduced = &fields[num_fields];
+    reduced->count = step_field_reduced(field, &reduced->value, &reduced->r, &reduced->z);
+    num_fields += reduced->count > 0;
+    if (data_quality == FULL)
     {
-        // Determine file path based on data type (reduced - 0, full - 1)
-        const char *filePath = (type == 0) ? "../data/time_reduced.txt" : "../data/time_aug.txt";
-        FILE *file = fopen(filePath, "a");
-        if (file == NULL)
+        BlobField *delta = &fields[num_fields];
+        delta->count = step_field_delta(field, &delta->value, &delta->r, &delta->z);
+        num_fields += delta->count > 0;
+    }
+
+    if (num_fields > 0)
+    {
+        BlobParams params;
+        // data_to_blob_detection.py draws the reduced data, combine.py the full field
+        if (data_quality == FULL)
         {
-            perror("Error opening file");
-            return;
+            blob_params_init(&params, BLOB_LAYOUT_FILL, 0.1);
         }
-        char buffer[128];
-        int written = snprintf(buffer, sizeof(buffer), "%.3f, %.3f\n", elapsed, *bytesReceived);
-        if (written < 0)
+        else
         {
-            perror("Error formatting data");
-            fclose(file);
-            return;
+            blob_params_init(&params, BLOB_LAYOUT_SUBPLOT, 0.3);
+        }
+        // The analysis workers share the cores
+        params.threads = params.threads / ANALYSIS_WORKERS > 0 ? params.threads / ANALYSIS_WORKERS : 1;
+
+        uint8_t *image = malloc((size_t)params.width * params.height * 3);
+        BlobResult result;
+        if (image != NULL && blob_render(fields, num_fields, &params, image) && blob_detect(image, &params, &result))
+        {
+            // Printed by the pool, in step order
+            analysis->status = ANALYSIS_BLOBS;
+            analysis->blob_number = result.count;
+            analysis->blob_diameter = result.avg_diameter;
+            analysis->blob_area = result.total_area;
+            analysis->overlap_ratio = result.overlap_ratio;
+            blob_result_free(&result);
+#if BLOB_SAVE_IMAGE
+            char path[256];
+            snprintf(path, sizeof(path), "%s/analysis/%d", DATA_DIRECTORY, step);
+            if (mkdir(DATA_DIRECTORY "/analysis", S_IRWXU) != 0 && errno != EEXIST)
+            {
+                perror("mkdir");
+            }
+            if (mkdir(path, S_IRWXU) != 0 && errno != EEXIST)
+            {
+                perror("mkdir");
+            }
+            strncat(path, "/unblobed.ppm", sizeof(path) - strlen(path) - 1);
+            blob_write_ppm(path, image, params.width, params.height);
+#else
+            (void)step;
+#endif
         }
-        if (fwrite(buffer, 1, strlen(buffer), file) != strlen(buffer))
+        else
         {
-            perror("Error writing to file");
+            analysis->status = ANALYSIS_FAILED;
         }
-        fclose(file);
-        //printf("Logged: Elapsed = %.3f, BytesReceived = %.3f to %s\n", elapsed, *bytesReceived, filePath);
-        gettimeofday(start, NULL);
-        *bytesReceived = 0.0;
+        free(image);
+    }
+    else
+    {
+        analysis->status = ANALYSIS_NO_INPUT;
     }
 }
 
-void run_blob_detection_scripts(DataQuality data_quality, int step)
+void run_blob_detection_scripts(DataQuality data_quality, int step, const StepField *field, AnalysisResult *result)
 {
     int status;
-    return;
+    if (BLOB_ANALYSIS == 0)
+    {
+        return;
+    }
+    if (BLOB_ANALYSIS == 1)
+    {
+        run_native_blob_detection(data_quality, step, field, result);
+        return;
+    }
     if (data_quality == REDUCED)
     {
         printf("Running Reduced blob detection...\n");
@@ -147,191 +310,241 @@ void *recv_data(void *arg)
 {
     int thread_index = *(int *)arg;
     free(arg);
-    int step = 0;
+    const StreamDescriptor *stream = &stream_table.streams[thread_index];
 
     // Initialize the socket
     char bind_address[50];
-    int port = BASE_PORT + thread_index;
+    int port = stream->port;
     void *socket = zmq_socket(context, ZMQ_PAIR);
     snprintf(bind_address, sizeof(bind_address), "tcp://0.0.0.0:%d", port);
     zmq_bind(socket, bind_address);
     printf("Binding to port %d\n", port);
+    event_log_name(thread_index, stream->name);
 
     DataQuality quality = shared_data_quality;
 
-    zmq_msg_t msg;
-    bool is_port_complete = false;
+    // Output directories stay open across steps
+    DirCache directories;
+    if (!dir_cache_init(&directories, DATA_DIRECTORY))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    // Steps begin in order but may overlap, each keeps its own files and acks
+    OpenStep *open_steps = NULL;
+    int next_step = 0;
+    bool last_step_ended = false;
 
     // Timing
-    struct timeval start, end;
+    struct timeval start;
+    gettimeofday(&start, NULL);
     double bytes_received = 0.0;
-    while (!is_port_complete)
+    while (!last_step_ended || open_steps != NULL)
     {
-        // Receive filenames
-        char **filenames = NULL;
-        char **filepaths = NULL;
-        int file_count = 0;
-        // Add filename to appropriate array based on quality
-        StepInfo *current_step = get_or_create_step(step, quality);
-        //printf("Step (%d) Started\n", step);
-        while (true)
+        FrameHeader header;
+        zmq_msg_t msg;
+        if (!frame_recv(socket, &header, &msg, 0))
+        {
+            fprintf(stderr, "Stream %s: receive failed: %s\n", stream->name, zmq_strerror(zmq_errno()));
+            zmq_msg_close(&msg);
+            break;
+        }
+        uint64_t arrival_ns = frame_clock_ns();
+        int step = (int)header.step;
+        if (header.stream != thread_index)
         {
-            zmq_msg_init(&msg);
-            zmq_msg_recv(&msg, socket, 0);
-            size_t filename_len = zmq_msg_size(&msg);
-            if (filename_len == 0)
+            fprintf(stderr, "Stream %s: dropping a %s frame of stream %d\n", stream->name, frame_type_name(header.type),
+                    header.stream);
+            zmq_msg_close(&msg);
+            continue;
+        }
+        if (header.type == FRAME_STEP_BEGIN)
+        {
+            if (step != next_step || last_step_ended)
             {
-                break; // End of filenames
+                fprintf(stderr, "Step (%d): dropping a step_begin, expected step %d\n", step, next_step);
+                zmq_msg_close(&msg);
+                continue;
             }
-
-            filenames = realloc(filenames, (file_count + 1) * sizeof(char *));
-            filepaths = realloc(filepaths, (file_count + 1) * sizeof(char *));
-            if (filenames == NULL || filepaths == NULL)
+            OpenStep *open = open_step(thread_index, quality, &directories, &header, &msg);
+            zmq_msg_close(&msg);
+            // Newest last, so the oldest open step is found first
+            OpenStep **tail = &open_steps;
+            while (*tail != NULL)
             {
-                perror("Failed to allocate memory");
-                exit(EXIT_FAILURE);
+                tail = &(*tail)->next;
             }
+            *tail = open;
+            next_step++;
+            continue;
+        }
 
-            filenames[file_count] = malloc(filename_len + 1);
-            memcpy(filenames[file_count], zmq_msg_data(&msg), filename_len);
-            filenames[file_count][filename_len] = '\0';
-            filepaths[file_count] = construct_filepath(filenames[file_count], step);
-            add_filename(thread_index == 0 ? &current_step->reduced_filenames : &current_step->augmentation_filenames, filenames[file_count]);
-            file_count++;
+        OpenStep **link = &open_steps;
+        while (*link != NULL && (*link)->step != step)
+        {
+            link = &(*link)->next;
+        }
+        OpenStep *open = *link;
+        bool file_frame = header.type == FRAME_CHUNK || header.type == FRAME_FILE_END;
+        if (open == NULL || (!file_frame && header.type != FRAME_STEP_END) ||
+            (file_frame && header.file_id >= (uint32_t)open->file_count))
+        {
+            fprintf(stderr, "Step (%d): dropping unexpected %s frame\n", step, frame_type_name(header.type));
+            zmq_msg_close(&msg);
+            continue;
         }
-        // Open files for writing
-        FILE *files[file_count];
-        for (int i = 0; i < file_count; i++)
+        if (header.type == FRAME_STEP_END)
         {
-            files[i] = fopen(filepaths[i], "ab");
-            if (files[i] == NULL)
+            zmq_msg_close(&msg);
+            if (open->ended)
             {
-                perror("Failed to open file");
-                exit(EXIT_FAILURE);
+                fprintf(stderr, "Step (%d): dropping a repeated step_end\n", step);
+                continue;
             }
+            open->ended = true;
+            open->last = (header.flags & FRAME_LAST_STEP) != 0;
         }
-
-        // Receive files chunks
-        int num_read_files = 0;
-        int file_index = 0;
-        int iter = 0;
-        while (num_read_files < file_count)
+        else if (open->finished[header.file_id])
+        {
+            fprintf(stderr, "Step (%d): dropping a %s frame after the end of %s\n", step,
+                    frame_type_name(header.type), open->filenames[header.file_id]);
+            zmq_msg_close(&msg);
+            continue;
+        }
+        else if (header.type == FRAME_FILE_END)
+        {
+            // Flush the partial batch so the sender can drain its window
+            if (open->ack.count > 0)
+            {
+                send_chunk_ack(socket, thread_index, step, &open->ack);
+            }
+            printf("Step (%d), Received file: %s\n", step, open->filenames[header.file_id]);
+            uint64_t file_size = open->file_sizes[header.file_id];
+            uint64_t sent = header.offset;
+            if (sent > file_size)
+            {
+                // Ending it there would grow the file past what STEP_BEGIN announced
+                fprintf(stderr, "Step (%d): %s ended at %llu past its size of %llu\n", step,
+                        open->filenames[header.file_id], (unsigned long long)sent, (unsigned long long)file_size);
+                sent = file_size;
+            }
+            open->num_read_files++;
+            open->finished[header.file_id] = true;
+            chunk_writer_finish(&open->writers[header.file_id], sent);
+            zmq_msg_close(&msg);
+        }
+        else
         {
-            // Receive file chunks
-            gettimeofday(&start, NULL);
-            zmq_msg_init(&msg);
-            zmq_msg_recv(&msg, socket, 0);
-            gettimeofday(&end, NULL);
             size_t chunk_size = zmq_msg_size(&msg);
-            if (chunk_size == 0)
+            uint64_t file_size = open->file_sizes[header.file_id];
+            if (header.offset > file_size || chunk_size > file_size - header.offset)
             {
-                printf("Step (%d), Received file: %s\n", step, filenames[file_index]);
-                num_read_files++;
-                iter = 0;
-                fclose(files[file_index]);
-                file_index = (file_index + 1) % file_count;
-                continue;
+                // Not written, but still acked so the sender's window moves on
+                fprintf(stderr, "Step (%d): dropping a chunk at %llu past the end of %s\n", step,
+                        (unsigned long long)header.offset, open->filenames[header.file_id]);
+                zmq_msg_close(&msg);
+            }
+            else
+            {
+                if (open->field_arrays[header.file_id] >= 0)
+                {
+                    step_field_add(open->info->field, open->field_arrays[header.file_id], header.offset,
+                                   zmq_msg_data(&msg), chunk_size);
+                }
+                // The writer keeps the message until its batch is on disk
+                chunk_writer_add_at(&open->writers[header.file_id], &msg, header.offset);
             }
-            char *buffer = malloc(chunk_size);
-            memcpy(buffer, zmq_msg_data(&msg), chunk_size);
-            fwrite(buffer, 1, chunk_size, files[file_index]);
-            free(buffer);
             // Logging Timing each 2 seconds
             bytes_received += chunk_size;
-            // log_time_info(&start, &bytes_received, thread_index == 0 ? 0 : 1);
-            double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
-            // Send elapsed time to log
-            zmq_msg_init_data(&msg, &elapsed, sizeof(double), NULL, NULL);
-            zmq_msg_send(&msg, socket, 0);
-            iter++;
-            if (iter % 10 == 0)
+            log_time_info(&start, &bytes_received, thread_index);
+            // The link delivered this chunk in the time since the previous one
+            // arrived, unless the sender was slower to hand it over than that
+            double interval = 0;
+            if (open->last_arrival_ns > 0)
+            {
+                double arrival_gap = (double)(arrival_ns - open->last_arrival_ns) / 1e9;
+                double send_gap = (double)(int64_t)(header.send_ns - open->last_send_ns) / 1e9;
+                interval = (send_gap > arrival_gap) ? send_gap : arrival_gap;
+            }
+            open->last_send_ns = header.send_ns;
+            open->last_arrival_ns = arrival_ns;
+            // Batch the timings into a cumulative ack
+            ChunkAck *ack = &open->ack;
+            ack->delay[ack->count] = (double)(int64_t)(arrival_ns - header.send_ns) / 1e9;
+            ack->interval[ack->count] = interval;
+            ack->echo_send_ns = header.send_ns;
+            ack->echo_recv_ns = arrival_ns;
+            ack->count++;
+            ack->acked_through++;
+            if (ack->count == ACK_BATCH)
             {
-                iter = 0;
-                file_index = (file_index + 1) % file_count;
+                send_chunk_ack(socket, thread_index, step, ack);
             }
+            continue;
         }
 
-        // Receive alert message
-        zmq_msg_init(&msg);
-        zmq_msg_recv(&msg, socket, 0);
-        int alert = atoi(zmq_msg_data(&msg));
-
-        // if 0 that means the port is complete and no more steps,
-        // if 1 move to the next step by incrementing step
-
-        // Logging And ack
-        if (thread_index == 0)
-        {
-            //printf("step (%d): received Reduced files\n", step);
-            // Ack message
-            char ack_message[256];
-            snprintf(ack_message, sizeof(ack_message), "step (%d): Received Reduced files", step);
-            zmq_msg_init_size(&msg, strlen(ack_message) + 1);
-            memcpy(zmq_msg_data(&msg), ack_message, strlen(ack_message) + 1);
-            zmq_msg_send(&msg, socket, 0);
-        }
-        else if (thread_index == 1)
-        {
-            //printf("step (%d): received Augmentation files\n", step);
-            // Ack message
-            char ack_message[256];
-            snprintf(ack_message, sizeof(ack_message), "step (%d): Received Augmentation files", step);
-            zmq_msg_init_size(&msg, strlen(ack_message) + 1);
-            memcpy(zmq_msg_data(&msg), ack_message, strlen(ack_message) + 1);
-            zmq_msg_send(&msg, socket, 0);
-        }
-        // Process alert
-        switch (alert)
+        // The step is done once it ended and every file is on disk
+        if (open->ended && open->num_read_files == open->file_count)
         {
-        case 1:
-            mark_step_complete(step, thread_index == 0 ? FULL : REDUCED);
-            step++;
-            break;
-        default:
-            mark_step_complete(step, thread_index == 0 ? FULL : REDUCED);
-            is_port_complete = true;
-            break;
+            last_step_ended = last_step_ended || open->last;
+            *link = open->next;
+            finish_step(socket, thread_index, open);
         }
     }
+    // Steps the connection left open keep what arrived
+    while (open_steps != NULL)
+    {
+        OpenStep *open = open_steps;
+        open_steps = open->next;
+        abandon_step(open);
+    }
 
-    // Mark all steps as complete
-    get_or_create_step(-1, quality);
+    // No more steps from this stream
+    mark_stream_finished(thread_index);
 
     // Cleanup
-    zmq_msg_close(&msg);
+    dir_cache_close(&directories);
     zmq_close(socket);
     pthread_exit(NULL);
     return NULL;
 }
 
-int main()
+int main(int argc, char **argv)
 {
     printf("Starting Receiver...\n");
+    if (!stream_table_init(&stream_table, argc > 1 ? argv[1] : STREAMS_CONFIG, BASE_PORT))
+    {
+        return EXIT_FAILURE;
+    }
+    // Timings go to a binary log, common/scripts/event_log_to_csv.py converts it
+    event_log_open(DATA_DIRECTORY "/events.bin");
     context = zmq_ctx_new();
-    init_step_array();
+    init_step_array(&stream_table);
 
-    pthread_t high_quality_thread, low_quality_thread, processor_thread;
+    pthread_t stream_threads[MAX_STREAMS], processor_thread;
 
     pthread_create(&processor_thread, NULL, step_processor_thread, NULL);
 
-    // Always create thread for index 0
-    int *thread_index_hq = malloc(sizeof(int));
-    *thread_index_hq = 0;
-    pthread_create(&high_quality_thread, NULL, recv_data, thread_index_hq);
-
-    // Create thread for index 1 (it will exit early if in REDUCED mode)
-    int *thread_index_lq = malloc(sizeof(int));
-    *thread_index_lq = 1;
-    pthread_create(&low_quality_thread, NULL, recv_data, thread_index_lq);
+    // One receiving thread per stream
+    for (int i = 0; i < stream_table.num_streams; i++)
+    {
+        int *thread_index = malloc(sizeof(int));
+        *thread_index = i;
+        pthread_create(&stream_threads[i], NULL, recv_data, thread_index);
+    }
 
-    pthread_join(high_quality_thread, NULL);
-    pthread_join(low_quality_thread, NULL);
+    for (int i = 0; i < stream_table.num_streams; i++)
+    {
+        pthread_join(stream_threads[i], NULL);
+    }
     pthread_join(processor_thread, NULL);
 
     printf("All threads completed.\n");
+    event_log_close();
     zmq_ctx_destroy(&context);
 
     cleanup_step_array();
+    stream_table_free(&stream_table);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,207 @@
+import matplotlib
+matplotlib.use('Agg')
+import matplotlib.pyplot as plt
+import numpy as np
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import cv2
+from scipy.spatial import Delaunay
+
+# Checks the receiver's native blob detection (blob_detect.c) against the
+# OpenCV path of data_to_blob_detection.py and combine.py on a synthetic
+# field: a D-shaped cross-section with Gaussian blobs on a radial profile.
+# On matplotlib's image the native detector must find the same keypoints as
+# OpenCV; drawn natively, the blob count must agree and the average diameter
+# stay within --tolerance. Builds a small driver around blob_detect.c with
+# the C compiler, so it runs without the receiver's dependencies.
+
+RECEIVER_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+DRIVER = r'''
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blob_detect.h"
+
+static void *read_file(const char *path, long *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    void *data = malloc(*size);
+    if (data == NULL || fread(data, 1, *size, file) != (size_t)*size)
+    {
+        perror("fread");
+        exit(1);
+    }
+    fclose(file);
+    return data;
+}
+
+// driver <subplot|fill> <field.bin> [image.rgb]: draws the field, or detects
+// on the given RGB image, and prints the count, the averages and the keypoints
+int main(int argc, char **argv)
+{
+    int fill = strcmp(argv[1], "fill") == 0;
+    BlobParams params;
+    blob_params_init(&params, fill ? BLOB_LAYOUT_FILL : BLOB_LAYOUT_SUBPLOT, fill ? 0.1 : 0.3);
+    long size;
+    double *data = read_file(argv[2], &size);
+    size_t count = size / (3 * sizeof(double));
+    BlobField field = {data, data + count, data + 2 * count, count};
+    BlobResult result;
+    bool ok;
+    if (argc > 3)
+    {
+        uint8_t *rgb = read_file(argv[3], &size);
+        ok = size == (long)params.width * params.height * 3 && blob_detect(rgb, &params, &result);
+        free(rgb);
+    }
+    else
+    {
+        ok = blob_analyse(&field, 1, &params, &result);
+    }
+    if (!ok)
+    {
+        return 1;
+    }
+    printf("%d %.6f %.6f\n", result.count, result.avg_diameter, result.total_area);
+    for (int i = 0; i < result.count; i++)
+    {
+        printf("%.3f %.3f %.3f\n", result.keypoints[i].x, result.keypoints[i].y, result.keypoints[i].size);
+    }
+    blob_result_free(&result);
+    free(data);
+    return 0;
+}
+'''
+
+
+def get_arguments():
+    parser = argparse.ArgumentParser(description='Compare native and OpenCV blob detection on a synthetic field')
+    parser.add_argument('--points', type=int, default=20000, help="Mesh nodes of the field. Default is 20000.")
+    parser.add_argument('--blobs', type=int, default=40, help="Gaussian blobs added to the field. Default is 40.")
+    parser.add_argument('--seed', type=int, default=1, help="Random seed. Default is 1.")
+    parser.add_argument('--layout', type=str, default='subplot', choices=['subplot', 'fill'],
+                        help="'subplot' as data_to_blob_detection.py draws, 'fill' as combine.py. Default is 'subplot'.")
+    parser.add_argument('--tolerance', type=float, default=0.07,
+                        help="Largest relative difference of the average diameters. Default is 0.07.")
+    parser.add_argument('--cc', type=str, default=os.environ.get('CC', 'cc'), help="C compiler. Default is $CC or cc.")
+    return parser.parse_args()
+
+
+def synthetic_field(points, blobs, seed):
+    rng = np.random.default_rng(seed)
+    u = rng.random(points)
+    theta = rng.random(points) * 2 * np.pi
+    rho = np.sqrt(u)
+    r = 1.7 + 0.6 * rho * np.cos(theta + 0.4 * np.sin(theta))
+    z = 1.1 * rho * np.sin(theta)
+    data = 0.2 * rho
+    for _ in range(blobs):
+        center_r = 1.7 + 0.5 * (rng.random() * 2 - 1)
+        center_z = 0.9 * (rng.random() * 2 - 1)
+        sigma = 0.03 + 0.05 * rng.random()
+        amplitude = rng.choice([-1, 1]) * (0.5 + rng.random())
+        data += amplitude * np.exp(-((r - center_r) ** 2 + (z - center_z) ** 2) / (2 * sigma * sigma))
+    return data, r, z
+
+
+def plot(data, r, z, layout, filename):
+    conn = Delaunay(np.transpose(np.array([z, r]))).simplices
+    fig, ax = plt.subplots(figsize=(8, 8))
+    plt.tricontourf(r, z, conn, data, cmap=plt.cm.jet,
+                    levels=np.linspace(np.min(data), np.max(data), num=25))
+    plt.xticks([])
+    plt.yticks([])
+    for spine in ax.spines.values():
+        spine.set_visible(False)
+    if layout == 'fill':
+        ax.margins(x=0, y=0)
+        plt.subplots_adjust(left=0, right=1, top=1, bottom=0)
+    plt.savefig(filename, dpi=100, format='png')
+    plt.close(fig)
+
+
+def opencv_blobs(image, layout):
+    params = cv2.SimpleBlobDetector_Params()
+    params.minThreshold = 10
+    params.maxThreshold = 200
+    params.filterByArea = 1
+    params.minArea = 120
+    params.filterByConvexity = 1
+    params.minConvexity = 0.1 if layout == 'fill' else 0.3
+    params.filterByInertia = 1
+    params.minInertiaRatio = 0.1
+    detector = cv2.SimpleBlobDetector_create(params)
+    mask = cv2.inRange(image, np.array([0, 0, 100], dtype="uint8"), np.array([204, 204, 255], dtype="uint8"))
+    output = cv2.bitwise_and(image, image, mask=mask)
+    keypoints = detector.detect(cv2.cvtColor(output, cv2.COLOR_BGR2GRAY))
+    count = len(keypoints)
+    avg_diameter = sum(k.size for k in keypoints) / count if count else 0.0
+    total_area = sum(3.14 * (k.size / 2) ** 2 for k in keypoints)
+    return count, avg_diameter, total_area, sorted((k.pt[0], k.pt[1], k.size) for k in keypoints)
+
+
+def build_driver(workdir, cc):
+    driver = os.path.join(workdir, 'driver.c')
+    binary = os.path.join(workdir, 'driver')
+    with open(driver, 'w') as f:
+        f.write(DRIVER)
+    subprocess.run([cc, '-std=gnu11', '-O2', '-I', RECEIVER_DIR, driver, os.path.join(RECEIVER_DIR, 'blob_detect.c'),
+                    '-o', binary, '-lm', '-lpthread'], check=True)
+    return binary
+
+
+def native_blobs(binary, layout, field_path, image_path=None):
+    command = [binary, layout, field_path] + ([image_path] if image_path else [])
+    lines = subprocess.run(command, check=True, capture_output=True, text=True).stdout.splitlines()
+    count, avg_diameter, total_area = lines[0].split()
+    keypoints = sorted(tuple(float(v) for v in line.split()) for line in lines[1:])
+    return int(count), float(avg_diameter), float(total_area), keypoints
+
+
+def same_keypoints(a, b):
+    return len(a) == len(b) and all(np.allclose(p, q, atol=2e-3) for p, q in zip(a, b))
+
+
+def main():
+    args = get_arguments()
+    data, r, z = synthetic_field(args.points, args.blobs, args.seed)
+    with tempfile.TemporaryDirectory() as workdir:
+        binary = build_driver(workdir, args.cc)
+        field_path = os.path.join(workdir, 'field.bin')
+        np.concatenate([data, r, z]).astype('<f8').tofile(field_path)
+        png_path = os.path.join(workdir, 'field.png')
+        plot(data, r, z, args.layout, png_path)
+        image = cv2.imread(png_path)
+        rgb_path = os.path.join(workdir, 'field.rgb')
+        np.ascontiguousarray(image[:, :, ::-1]).tofile(rgb_path)
+        reference = opencv_blobs(image, args.layout)
+        same_image = native_blobs(binary, args.layout, field_path, rgb_path)
+        native = native_blobs(binary, args.layout, field_path)
+
+    print(f"opencv: {reference[0]} blobs, avg diameter {reference[1]:.3f}, aggregate blob area {reference[2]:.1f}")
+    detector_matches = same_keypoints(reference[3], same_image[3])
+    print(f"native detector on the same image: {same_image[0]} blobs,",
+          "same keypoints" if detector_matches else "DIFFERENT keypoints")
+    print(f"native: {native[0]} blobs, avg diameter {native[1]:.3f}, aggregate blob area {native[2]:.1f}")
+    difference = abs(native[1] - reference[1]) / reference[1] if reference[1] > 0 else abs(native[1])
+    print(f"avg diameter difference {100 * difference:.2f}%")
+    if not detector_matches or native[0] != reference[0] or difference > args.tolerance:
+        print("MISMATCH")
+        sys.exit(1)
+    print("OK")
+
+
+if __name__ == '__main__':
+    main()
@@ -6,7 +6,7 @@ echo "Setup for Client started"
 sudo apt-get update
 
 # Install necessary packages
-sudo apt-get install -y build-essential libzmq3-dev python3 python3-pip python3-venv cmake pkg-config firewalld
+sudo apt-get install -y build-essential libzmq3-dev python3 python3-pip python3-venv cmake pkg-config firewalld libjson-c-dev
 
 # Create Python virtual environment
 python3 -m venv ../venv
@@ -17,8 +17,8 @@ source ./venv/bin/activate
 # Install Python dependencies
 pip install numpy matplotlib scipy opencv-python-headless
 
-# Disable firewall in ports 4444 to 4448 in order for the Socket to communicate
-for port in {4444..4448}; do
+# Disable firewall in ports 4444 to 4451 (one per stream, up to MAX_STREAMS) in order for the Socket to communicate
+for port in {4444..4451}; do
     sudo firewall-cmd --zone=public --add-port=${port}/tcp --permanent
 done
 sudo firewall-cmd --reload
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "step_field.h"
+
+static const char *const field_files[FIELD_ARRAYS] = {
+    [FIELD_REDUCED] = REDUCED_FILE,
+    [FIELD_DELTA_VALUE] = DELTA_VALUE_FILE,
+    [FIELD_DELTA_R] = DELTA_R_FILE,
+    [FIELD_DELTA_Z] = DELTA_Z_FILE,
+};
+
+StepField *step_field_create(void)
+{
+    StepField *field = calloc(1, sizeof(StepField));
+    if (field == NULL)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&field->refs, 1);
+    return field;
+}
+
+StepField *step_field_retain(StepField *field)
+{
+    atomic_fetch_add(&field->refs, 1);
+    return field;
+}
+
+void step_field_release(StepField *field)
+{
+    if (field == NULL || atomic_fetch_sub(&field->refs, 1) > 1)
+    {
+        return;
+    }
+    for (int i = 0; i < FIELD_ARRAYS; i++)
+    {
+        if (field->buffers[i].data != NULL)
+        {
+            munmap(field->buffers[i].data, field->buffers[i].size);
+        }
+    }
+    free(field);
+}
+
+// Map a buffer for the file when it is an analysis input. Returns the array
+// the file's chunks go to, or -1 when the step keeps no copy of it.
+int step_field_reserve(StepField *field, const char *name, uint64_t size)
+{
+    int array = -1;
+    for (int i = 0; i < FIELD_ARRAYS; i++)
+    {
+        if (strcmp(name, field_files[i]) == 0)
+        {
+            array = i;
+            break;
+        }
+    }
+    // A second file of the same name in the step keeps only its disk copy
+    if (array < 0 || size == 0 || field->buffers[array].data != NULL)
+    {
+        return -1;
+    }
+    FieldBuffer *buffer = &field->buffers[array];
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+    buffer->data = data;
+    buffer->size = size;
+    buffer->received = 0;
+    return array;
+}
+
+// Copy a chunk that landed at offset of the array's file
+void step_field_add(StepField *field, int array, uint64_t offset, const void *data, size_t length)
+{
+    FieldBuffer *buffer = &field->buffers[array];
+    if (offset > buffer->size || length > buffer->size - offset)
+    {
+        fprintf(stderr, "Field %s: chunk at %llu past the end of the file\n", field_files[array],
+                (unsigned long long)offset);
+        return;
+    }
+    memcpy(buffer->data + offset, data, length);
+    if (offset <= buffer->received && offset + length > buffer->received)
+    {
+        buffer->received = offset + length;
+    }
+}
+
+// The reduced nodes whose value, r and z all arrived
+size_t step_field_reduced(const StepField *field, const double **value, const double **r, const double **z)
+{
+    const FieldBuffer *buffer = &field->buffers[FIELD_REDUCED];
+    size_t count = buffer->size / (3 * sizeof(double));
+    if (count == 0 || buffer->received < 2 * count * sizeof(double))
+    {
+        return 0;
+    }
+    const double *reduced = (const double *)buffer->data;
+    *value = reduced;
+    *r = reduced + count;
+    *z = reduced + 2 * count;
+    size_t arrived = (buffer->received - 2 * count * sizeof(double)) / sizeof(double);
+    return arrived < count ? arrived : count;
+}
+
+// The delta nodes that arrived in all three files, a cut-short stream stops
+// at its shortest file
+size_t step_field_delta(const StepField *field, const double **value, const double **r, const double **z)
+{
+    size_t received = SIZE_MAX;
+    for (int i = FIELD_DELTA_VALUE; i <= FIELD_DELTA_Z; i++)
+    {
+        if (field->buffers[i].data == NULL)
+        {
+            return 0;
+        }
+        if (field->buffers[i].received < received)
+        {
+            received = field->buffers[i].received;
+        }
+    }
+    *value = (const double *)field->buffers[FIELD_DELTA_VALUE].data;
+    *r = (const double *)field->buffers[FIELD_DELTA_R].data;
+    *z = (const double *)field->buffers[FIELD_DELTA_Z].data;
+    return received / sizeof(double);
+}
@@ -0,0 +1,51 @@
+#ifndef STEP_FIELD_H
+#define STEP_FIELD_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Analysis inputs: the reduced file holds the value, r and z arrays back to
+// back, the delta stream sends one file per array
+#define REDUCED_FILE "reduced_data_xgc_16.bin"
+#define DELTA_VALUE_FILE "delta_xgc_o.bin"
+#define DELTA_R_FILE "delta_r_xgc_o.bin"
+#define DELTA_Z_FILE "delta_z_xgc_o.bin"
+
+typedef enum
+{
+    FIELD_REDUCED,
+    FIELD_DELTA_VALUE,
+    FIELD_DELTA_R,
+    FIELD_DELTA_Z,
+    FIELD_ARRAYS
+} FieldArray;
+
+// One input file kept in memory. The buffer is an anonymous mapping sized
+// from the file table, so a cut-short file only commits the pages that arrived.
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t received; // bytes from offset 0 that arrived, chunks come in offset order
+} FieldBuffer;
+
+// A step's analysis inputs, filled by the receiving threads as the chunks
+// land so the analysis does not read the files back. Each buffer is written
+// by the thread of the stream that carries the file. Held by the step and by
+// its analysis job, freed when both let go.
+typedef struct
+{
+    FieldBuffer buffers[FIELD_ARRAYS];
+    atomic_int refs;
+} StepField;
+
+StepField *step_field_create(void);
+StepField *step_field_retain(StepField *field);
+void step_field_release(StepField *field);
+int step_field_reserve(StepField *field, const char *name, uint64_t size);
+void step_field_add(StepField *field, int array, uint64_t offset, const void *data, size_t length);
+size_t step_field_reduced(const StepField *field, const double **value, const double **r, const double **z);
+size_t step_field_delta(const StepField *field, const double **value, const double **r, const double **z);
+
+#endif // STEP_FIELD_H
@@ -3,15 +3,30 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdatomic.h>
+#include <limits.h>
 #include "step_manager.h"
+#include "event_log.h"
 
 #define INITIAL_CAPACITY 100
+// Initial number of ring slots, must be a power of two
+#define STEP_INDEX_CAPACITY 64
 
 // Global variables
-StepArray step_array = {NULL, 0, 0};
+StepArray step_array = {0};
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t step_created = PTHREAD_COND_INITIALIZER;
 atomic_int current_processing_step = 0;
+// Streams every step waits for
+static const StreamTable *streams = NULL;
+// Receiving threads that have no more steps to create
+static int finished_streams = 0;
+static bool stream_finished[MAX_STREAMS];
+// Runs the analysis of completed steps
+static AnalysisPool analysis_pool;
+
+// Declare external function that will be defined in main.c
+extern void run_blob_detection_scripts(DataQuality quality, int step, const StepField *field, AnalysisResult *result);
+extern void *context;
 
 void init_filename_array(FilenameArray *arr)
 {
@@ -31,41 +46,174 @@ void add_filename(FilenameArray *arr, const char *filename)
     arr->filename_count++;
 }
 
-void init_step_array()
+void init_step_array(const StreamTable *table)
 {
-    step_array.capacity = INITIAL_CAPACITY;
+    streams = table;
+    step_array.capacity = STEP_INDEX_CAPACITY;
+    step_array.first = 0;
     step_array.count = 0;
-    step_array.steps = malloc(sizeof(StepInfo) * step_array.capacity);
+    step_array.live = 0;
+    step_array.processed_through = 0;
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        step_array.released_through[i] = 0;
+    }
+    step_array.slots = calloc(step_array.capacity, sizeof(StepInfo *));
+    analysis_pool_start(&analysis_pool, ANALYSIS_WORKERS, ANALYSIS_IN_ORDER, run_blob_detection_scripts);
 }
 
-StepInfo *get_or_create_step(int step, DataQuality quality)
+// A step from the free list, or a new one carved from the current block.
+// Its filename arrays are empty and its condition is initialized. Caller holds mutex.
+static StepInfo *alloc_step(void)
 {
-    pthread_mutex_lock(&mutex);
+    StepInfo *info = step_array.free_list;
+    if (info != NULL)
+    {
+        step_array.free_list = info->next_free;
+        return info;
+    }
+    if (step_array.blocks == NULL || step_array.block_used == STEP_BLOCK_SIZE)
+    {
+        StepBlock *block = calloc(1, sizeof(StepBlock));
+        if (block == NULL)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        block->next = step_array.blocks;
+        step_array.blocks = block;
+        step_array.block_used = 0;
+    }
+    info = &step_array.blocks->steps[step_array.block_used++];
+    pthread_cond_init(&info->completed, NULL);
+    for (int i = 0; i < streams->num_streams; i++)
+    {
+        init_filename_array(&info->filenames[i]);
+    }
+    return info;
+}
 
-    // Find existing step
-    for (int i = 0; i < step_array.count; i++)
+// Drop the step from the index and recycle it. Caller holds mutex.
+static void retire_step(StepInfo *info)
+{
+    for (int i = 0; i < streams->num_streams; i++)
     {
-        if (step_array.steps[i].step == step)
+        FilenameArray *filenames = &info->filenames[i];
+        for (int j = 0; j < filenames->filename_count; j++)
         {
-            pthread_mutex_unlock(&mutex);
-            return &step_array.steps[i];
+            free(filenames->filenames[j]);
         }
+        filenames->filename_count = 0;
     }
+    // The analysis job may still hold the field
+    step_field_release(info->field);
+    info->field = NULL;
+    step_array.slots[info->step & (step_array.capacity - 1)] = NULL;
+    info->next_free = step_array.free_list;
+    step_array.free_list = info;
+    step_array.live--;
+}
 
-    // Create new step if not found
-    if (step_array.count >= step_array.capacity)
+// Retire, oldest first, the steps that were processed and that no stream
+// will touch again. Caller holds mutex.
+static void retire_steps(void)
+{
+    int released = INT_MAX;
+    for (int i = 0; i < streams->num_streams; i++)
+    {
+        if (step_array.released_through[i] < released)
+        {
+            released = step_array.released_through[i];
+        }
+    }
+    while (step_array.first < step_array.processed_through && step_array.first < released)
     {
-        step_array.capacity *= 2;
-        step_array.steps = realloc(step_array.steps, sizeof(StepInfo) * step_array.capacity);
+        StepInfo *info = step_array.slots[step_array.first & (step_array.capacity - 1)];
+        if (info != NULL && info->step == step_array.first)
+        {
+            retire_step(info);
+        }
+        step_array.first++;
     }
+}
 
-    StepInfo *new_step = &step_array.steps[step_array.count];
+// Caller holds mutex
+static StepInfo *find_step(int step)
+{
+    if (step < step_array.first || step - step_array.first >= step_array.capacity)
+    {
+        return NULL;
+    }
+    StepInfo *info = step_array.slots[step & (step_array.capacity - 1)];
+    return (info != NULL && info->step == step) ? info : NULL;
+}
+
+// Double the ring until step fits next to the oldest step it covers. Caller holds mutex.
+static void grow_step_index(int step)
+{
+    int capacity = step_array.capacity;
+    while (step - step_array.first >= capacity)
+    {
+        capacity *= 2;
+    }
+    if (capacity == step_array.capacity)
+    {
+        return;
+    }
+    StepInfo **slots = calloc(capacity, sizeof(StepInfo *));
+    if (slots == NULL)
+    {
+        perror("Failed to grow the step index");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < step_array.capacity; i++)
+    {
+        StepInfo *info = step_array.slots[i];
+        if (info != NULL)
+        {
+            slots[info->step & (capacity - 1)] = info;
+        }
+    }
+    free(step_array.slots);
+    step_array.slots = slots;
+    step_array.capacity = capacity;
+}
+
+StepInfo *get_or_create_step(int step, DataQuality quality)
+{
+    pthread_mutex_lock(&mutex);
+
+    // Find existing step
+    StepInfo *new_step = find_step(step);
+    if (new_step != NULL)
+    {
+        pthread_mutex_unlock(&mutex);
+        return new_step;
+    }
+
+    // Create new step if not found. A stream asks for a step before it
+    // releases it, so the step cannot have been retired already.
+    if (step < step_array.first)
+    {
+        fprintf(stderr, "Step %d was requested after it was retired\n", step);
+        exit(EXIT_FAILURE);
+    }
+    grow_step_index(step);
+    new_step = alloc_step();
     new_step->step = step;
-    new_step->status.reduced_done = false;
-    new_step->status.augmentation_done = (quality == REDUCED ? true : false);
-    init_filename_array(&new_step->reduced_filenames);
-    init_filename_array(&new_step->augmentation_filenames);
+    new_step->field = step_field_create();
+    new_step->status.num_done = 0;
+    for (int i = 0; i < streams->num_streams; i++)
+    {
+        // A reduced run does not wait for the refinement streams
+        // A finished stream will not deliver anything more either
+        new_step->status.done[i] = (quality == REDUCED && streams->streams[i].priority == STREAM_LOW) || stream_finished[i];
+        new_step->status.num_done += new_step->status.done[i];
+    }
+    step_array.slots[step & (step_array.capacity - 1)] = new_step;
     step_array.count++;
+    step_array.live++;
+    pthread_cond_broadcast(&step_created);
 
     pthread_mutex_unlock(&mutex);
     return new_step;
@@ -73,13 +221,9 @@ StepInfo *get_or_create_step(int step, DataQuality quality)
 
 bool is_step_complete(StepInfo *step)
 {
-    return step->status.reduced_done && step->status.augmentation_done;
+    return step->status.num_done == streams->num_streams;
 }
 
-// Declare external function that will be defined in main.c
-extern void run_blob_detection_scripts(DataQuality quality, int step);
-extern void *context;
-
 void *step_processor_thread(void *arg)
 {
     bool enable = true;
@@ -96,114 +240,153 @@ void *step_processor_thread(void *arg)
         pthread_mutex_lock(&mutex);
         int current_step = atomic_load(&current_processing_step);
 
-        // Exit the loop if current_step is -1
-        if (current_step == -1)
+        // Sleep until a receiving thread creates the step, unless every
+        // stream is done and it never will be
+        StepInfo *step_info;
+        while ((step_info = find_step(current_step)) == NULL && finished_streams < streams->num_streams)
         {
-            pthread_mutex_unlock(&mutex);
-            enable = false;
-            break;
+            pthread_cond_wait(&step_created, &mutex);
         }
-
-        // Find the step we're currently processing
-        StepInfo *step_info = NULL;
-        for (int i = 0; i < step_array.count; i++)
-        {
-            if (step_array.steps[i].step == current_step)
-            {
-                step_info = &step_array.steps[i];
-                break;
-            }
-        }
-
-        if (!step_info)
+        if (step_info == NULL)
         {
             pthread_mutex_unlock(&mutex);
-            continue;
+            enable = false;
+            break;
         }
 
         // Wait for the current step to be complete
-        while (step_info && !is_step_complete(step_info))
+        while (!is_step_complete(step_info))
         {
-            pthread_cond_wait(&cond, &mutex);
+            pthread_cond_wait(&step_info->completed, &mutex);
         }
 
-        // log the current step to a file
+        // log the time the processor waited for the current step
         gettimeofday(&end, NULL);
         double time_taken = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
-        // store time taken in a file appending mode
-        FILE *log_file = fopen("../data/log.txt", "a");
-        fprintf(log_file, "%f\n", time_taken);
-        fclose(log_file);
-
-        printf("Processing step %d (Reduced files: %d, Augmentation files: %d)\n",
-               current_step,
-               step_info->reduced_filenames.filename_count,
-               step_info->augmentation_filenames.filename_count);
-        pthread_mutex_unlock(&mutex);
-
-        if (step_info->augmentation_filenames.filename_count > 0)
-        {
-            run_blob_detection_scripts(FULL, current_step);
-        }
-        else
-        {
-            run_blob_detection_scripts(REDUCED, current_step);
-        }
+        event_log(EVENT_STEP_WAIT, 0, current_step, time_taken, 0);
 
-        // Move to next step
-        pthread_mutex_lock(&mutex);
-        // 2 because we added -1 step in receiver.c
-        // Move to the next step
-        for(int i=0; i<step_array.count; i++)
+        printf("Processing step %d (", current_step);
+        int refinement_files = 0;
+        for (int i = 0; i < streams->num_streams; i++)
         {
-            if(step_array.steps[i].step == current_step)
+            printf("%s files: %d%s", streams->streams[i].name, step_info->filenames[i].filename_count,
+                   i + 1 < streams->num_streams ? ", " : ")\n");
+            if (streams->streams[i].priority == STREAM_LOW)
             {
-                atomic_store(&current_processing_step, step_array.steps[i+1].step);
+                refinement_files += step_info->filenames[i].filename_count;
             }
         }
+        // The step's in-memory inputs go with it, so the analysis reads no files
+        StepField *field = step_field_retain(step_info->field);
         pthread_mutex_unlock(&mutex);
+
+        // Hand the step to the analysis workers, waits while they are a full queue behind
+        analysis_pool_submit(&analysis_pool, current_step, refinement_files > 0 ? FULL : REDUCED, field);
+
+        // Steps are numbered consecutively by every stream
+        pthread_mutex_lock(&mutex);
+        step_array.processed_through = current_step + 1;
+        retire_steps();
+        pthread_mutex_unlock(&mutex);
+        atomic_store(&current_processing_step, current_step + 1);
     }
+    // Let the workers finish what is queued
+    analysis_pool_stop(&analysis_pool);
     pthread_exit(NULL);
     return NULL;
 }
 
-void mark_step_complete(int step, bool is_augmentation)
+// Receiving threads call this before taking on a step, so a full analysis
+// queue holds them (and through the socket, the sender) back
+void wait_for_analysis_room(void)
+{
+    analysis_pool_wait_for_room(&analysis_pool);
+}
+
+// Completed steps that wait for or are in analysis
+int analysis_backlog(void)
+{
+    return analysis_pool_backlog(&analysis_pool);
+}
+
+// Count the stream as done with the step. Caller holds mutex.
+static void mark_stream_done(StepInfo *info, int stream_index)
+{
+    if (info != NULL && !info->status.done[stream_index])
+    {
+        info->status.done[stream_index] = true;
+        info->status.num_done++;
+        if (is_step_complete(info))
+        {
+            pthread_cond_broadcast(&info->completed);
+        }
+    }
+}
+
+// The stream has received the step and will not touch its StepInfo again
+void mark_step_complete(int step, int stream_index)
+{
+    pthread_mutex_lock(&mutex);
+    mark_stream_done(find_step(step), stream_index);
+    if (step + 1 > step_array.released_through[stream_index])
+    {
+        step_array.released_through[stream_index] = step + 1;
+    }
+    retire_steps();
+    pthread_mutex_unlock(&mutex);
+}
+
+// A receiving thread has created its last step. A stream that stopped early
+// (its socket failed) left steps open that it will never complete; count it
+// done for those and for any the other streams create later, so the step
+// processor does not wait for it.
+void mark_stream_finished(int stream_index)
 {
     pthread_mutex_lock(&mutex);
-    for (int i = 0; i < step_array.count; i++)
+    finished_streams++;
+    stream_finished[stream_index] = true;
+    for (int i = 0; i < step_array.capacity; i++)
     {
-        if (step_array.steps[i].step == step)
+        StepInfo *info = step_array.slots[i];
+        if (info != NULL && info->step >= step_array.released_through[stream_index])
         {
-            if (is_augmentation)
-            {
-                step_array.steps[i].status.augmentation_done = true;
-            }
-            else
-            {
-                step_array.steps[i].status.reduced_done = true;
-            }
-            pthread_cond_signal(&cond);
-            break;
+            mark_stream_done(info, stream_index);
         }
     }
+    step_array.released_through[stream_index] = INT_MAX;
+    retire_steps();
+    pthread_cond_broadcast(&step_created);
     pthread_mutex_unlock(&mutex);
 }
 
 void cleanup_step_array()
 {
-    for (int i = 0; i < step_array.count; i++)
+    for (int i = 0; i < step_array.capacity; i++)
     {
-        for (int j = 0; j < step_array.steps[i].reduced_filenames.filename_count; j++)
+        if (step_array.slots[i] != NULL)
         {
-            free(step_array.steps[i].reduced_filenames.filenames[j]);
+            retire_step(step_array.slots[i]);
         }
-        free(step_array.steps[i].reduced_filenames.filenames);
+    }
+    free(step_array.slots);
+    step_array.slots = NULL;
 
-        for (int j = 0; j < step_array.steps[i].augmentation_filenames.filename_count; j++)
+    // Every step carved so far is retired now, release the blocks
+    for (StepBlock *block = step_array.blocks; block != NULL;)
+    {
+        int used = (block == step_array.blocks) ? step_array.block_used : STEP_BLOCK_SIZE;
+        for (int i = 0; i < used; i++)
         {
-            free(step_array.steps[i].augmentation_filenames.filenames[j]);
+            for (int k = 0; k < streams->num_streams; k++)
+            {
+                free(block->steps[i].filenames[k].filenames);
+            }
+            pthread_cond_destroy(&block->steps[i].completed);
         }
-        free(step_array.steps[i].augmentation_filenames.filenames);
+        StepBlock *next = block->next;
+        free(block);
+        block = next;
     }
-    free(step_array.steps);
-}
\ No newline at end of file
+    step_array.blocks = NULL;
+    step_array.free_list = NULL;
+}
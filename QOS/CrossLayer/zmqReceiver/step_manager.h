@@ -2,6 +2,7 @@
 #define STEP_MANAGER_H
 
 #include "step_types.h"
+#include "analysis_pool.h"
 #include <pthread.h>
 #include <stdatomic.h>
 #include <sys/time.h>
@@ -9,15 +10,19 @@
 
 void init_filename_array(FilenameArray *arr);
 void add_filename(FilenameArray *arr, const char *filename);
-void init_step_array();
+void init_step_array(const StreamTable *table);
 StepInfo* get_or_create_step(int step, DataQuality quality);
+void mark_step_complete(int step, int stream_index);
+void mark_stream_finished(int stream_index);
+void wait_for_analysis_room(void);
+int analysis_backlog(void);
 void *step_processor_thread(void *arg);
 void cleanup_step_array();
 
 // External variables that need to be accessible
 extern StepArray step_array;
 extern pthread_mutex_t mutex;
-extern pthread_cond_t cond;
+extern pthread_cond_t step_created;
 extern atomic_int current_processing_step;
 
 #endif // STEP_MANAGER_H
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define STEP_TYPES_H
 
 #include <stdbool.h>
+#include <pthread.h>
+#include "streams.h"
+#include "step_field.h"
 
 typedef enum {
     FULL,
@@ -15,25 +18,46 @@ typedef struct {
     int capacity;
 } FilenameArray;
 
-// Structure to store completion status for each quality level
+// Structure to store completion status for each stream
 typedef struct {
-    bool reduced_done;
-    bool augmentation_done;
+    bool done[MAX_STREAMS];
+    int num_done;
 } CompletionStatus;
 
 // Structure to store step information
-typedef struct {
+typedef struct StepInfo {
     int step;
-    FilenameArray reduced_filenames;
-    FilenameArray augmentation_filenames; 
+    FilenameArray filenames[MAX_STREAMS];
     CompletionStatus status;
+    StepField *field; // analysis inputs, filled as the chunks land
+    pthread_cond_t completed; // broadcast when the last stream marks the step done
+    struct StepInfo *next_free;
 } StepInfo;
 
-// Array to store steps
+// Steps are carved from blocks that are never moved or freed before exit,
+// retired steps go back to a free list with their filename buffers
+#define STEP_BLOCK_SIZE 64
+
+typedef struct StepBlock {
+    StepInfo steps[STEP_BLOCK_SIZE];
+    struct StepBlock *next;
+} StepBlock;
+
+// Steps indexed by number: step lives in slot step & (capacity - 1) of a
+// power-of-two ring. The ring grows before a new step would land on a slot
+// that is still held, so a lookup is one slot read. Steps below first are
+// retired: processed and released by every stream.
 typedef struct {
-    StepInfo *steps;
-    int count;
+    StepInfo **slots;
     int capacity;
+    int first; // lowest step number the ring covers
+    int count; // steps created
+    int live;  // steps created and not retired yet
+    int processed_through;            // steps below this were processed
+    int released_through[MAX_STREAMS]; // steps below this are no longer used by the stream
+    StepBlock *blocks;
+    int block_used; // steps carved from the newest block
+    StepInfo *free_list;
 } StepArray;
 
 #endif // STEP_TYPES_H
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <json-c/json.h>
+#include "streams.h"
+
+static void add_stream(StreamTable *table, const char *name, const char *directory, StreamPriority priority, int port)
+{
+    StreamDescriptor *stream = &table->streams[table->num_streams++];
+    memset(stream, 0, sizeof(StreamDescriptor));
+    snprintf(stream->name, sizeof(stream->name), "%s", name);
+    snprintf(stream->directory, sizeof(stream->directory), "%s", directory);
+    stream->priority = priority;
+    stream->weight = 1.0;
+    stream->min_share = 0.0;
+    stream->max_share = 1.0;
+    stream->port = port;
+}
+
+static void add_file(StreamDescriptor *stream, const char *filename)
+{
+    stream->filenames[stream->num_files++] = strdup(filename);
+}
+
+// The two streams the experiment was written for: the reduced data on
+// base_port and the three augmentation files on base_port + 1
+void stream_table_default(StreamTable *table, int base_port)
+{
+    table->num_steps = DEFAULT_NUM_STEPS;
+    table->num_streams = 0;
+    add_stream(table, "reduced", "reduced", STREAM_HIGH, base_port);
+    add_file(&table->streams[0], "reduced_data_xgc_16.bin");
+    add_stream(table, "aug", "delta", STREAM_LOW, base_port + 1);
+    add_file(&table->streams[1], "delta_r_xgc_o.bin");
+    add_file(&table->streams[1], "delta_z_xgc_o.bin");
+    add_file(&table->streams[1], "delta_xgc_o.bin");
+}
+
+static double get_double(json_object *obj, const char *key, double fallback)
+{
+    json_object *value;
+    return json_object_object_get_ex(obj, key, &value) ? json_object_get_double(value) : fallback;
+}
+
+static const char *get_string(json_object *obj, const char *key, const char *fallback)
+{
+    json_object *value;
+    return json_object_object_get_ex(obj, key, &value) ? json_object_get_string(value) : fallback;
+}
+
+// Parse {"steps": N, "streams": [{"name", "directory", "priority": "high"|"low", "weight",
+// "min_share", "max_share", "port", "files": [...]}, ...]}. Missing fields take
+// the defaults of add_stream, ports default to base_port + index.
+bool stream_table_load(StreamTable *table, const char *path, int base_port)
+{
+    table->num_streams = 0;
+    json_object *root = json_object_from_file(path);
+    if (root == NULL)
+    {
+        fprintf(stderr, "Failed to parse %s\n", path);
+        return false;
+    }
+    json_object *streams;
+    if (!json_object_object_get_ex(root, "streams", &streams) || !json_object_is_type(streams, json_type_array))
+    {
+        fprintf(stderr, "%s: missing \"streams\" array\n", path);
+        json_object_put(root);
+        return false;
+    }
+    table->num_steps = (int)get_double(root, "steps", DEFAULT_NUM_STEPS);
+    if (table->num_steps < 1)
+    {
+        fprintf(stderr, "%s: \"steps\" must be at least 1\n", path);
+        json_object_put(root);
+        return false;
+    }
+    int num_streams = json_object_array_length(streams);
+    if (num_streams < 1 || num_streams > MAX_STREAMS)
+    {
+        fprintf(stderr, "%s: expected 1 to %d streams, got %d\n", path, MAX_STREAMS, num_streams);
+        json_object_put(root);
+        return false;
+    }
+
+    double total_min_share = 0;
+    for (int i = 0; i < num_streams; i++)
+    {
+        json_object *entry = json_object_array_get_idx(streams, i);
+        char default_name[STREAM_NAME_SIZE];
+        snprintf(default_name, sizeof(default_name), "stream%d", i);
+        const char *name = get_string(entry, "name", default_name);
+        const char *priority = get_string(entry, "priority", "high");
+        add_stream(table, name, get_string(entry, "directory", name),
+                   strcmp(priority, "low") == 0 ? STREAM_LOW : STREAM_HIGH,
+                   (int)get_double(entry, "port", base_port + i));
+
+        StreamDescriptor *stream = &table->streams[i];
+        stream->weight = get_double(entry, "weight", stream->weight);
+        stream->min_share = get_double(entry, "min_share", stream->min_share);
+        stream->max_share = get_double(entry, "max_share", stream->max_share);
+        if (stream->weight <= 0 || stream->min_share < 0 || stream->max_share > 1 || stream->min_share > stream->max_share)
+        {
+            fprintf(stderr, "%s: stream %s needs weight > 0 and 0 <= min_share <= max_share <= 1\n", path, stream->name);
+            json_object_put(root);
+            stream_table_free(table);
+            return false;
+        }
+        total_min_share += stream->min_share;
+
+        json_object *files;
+        if (json_object_object_get_ex(entry, "files", &files) && json_object_is_type(files, json_type_array))
+        {
+            int num_files = json_object_array_length(files);
+            if (num_files > MAX_STREAM_FILES)
+            {
+                fprintf(stderr, "%s: stream %s has %d files, at most %d are allowed\n", path, stream->name, num_files,
+                        MAX_STREAM_FILES);
+                json_object_put(root);
+                stream_table_free(table);
+                return false;
+            }
+            for (int j = 0; j < num_files; j++)
+            {
+                json_object *file = json_object_array_get_idx(files, j);
+                if (!json_object_is_type(file, json_type_string) || json_object_get_string(file)[0] == '\0')
+                {
+                    fprintf(stderr, "%s: file %d of stream %s must be a non-empty string\n", path, j, stream->name);
+                    json_object_put(root);
+                    stream_table_free(table);
+                    return false;
+                }
+                add_file(stream, json_object_get_string(file));
+            }
+        }
+    }
+    json_object_put(root);
+
+    if (total_min_share > 1.0)
+    {
+        fprintf(stderr, "%s: min_share of all streams adds up to more than 1\n", path);
+        stream_table_free(table);
+        return false;
+    }
+    return true;
+}
+
+// Load path when it exists, otherwise fall back to the built-in two streams
+bool stream_table_init(StreamTable *table, const char *path, int base_port)
+{
+    if (access(path, R_OK) != 0)
+    {
+        printf("No %s, using the reduced/aug streams\n", path);
+        stream_table_default(table, base_port);
+        return true;
+    }
+    if (!stream_table_load(table, path, base_port))
+    {
+        return false;
+    }
+    printf("Loaded %d streams from %s\n", table->num_streams, path);
+    return true;
+}
+
+void stream_table_free(StreamTable *table)
+{
+    for (int i = 0; i < table->num_streams; i++)
+    {
+        for (int j = 0; j < table->streams[i].num_files; j++)
+        {
+            free(table->streams[i].filenames[j]);
+        }
+        table->streams[i].num_files = 0;
+    }
+    table->num_streams = 0;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+#include "chunk_tuner.h"
+
+// Delivery rate window and the minimum gap between two size decisions
+#define TUNER_RATE_WINDOW 1.0
+#define TUNER_RATE_TAU 0.25
+#define TUNER_MIN_INTERVAL 0.01
+// Probing stops once a doubling gains less than this
+#define TUNER_PROBE_GAIN 1.05
+// Smoothed RTT this far above the minimum means a queue is building
+#define TUNER_RTT_INFLATION 1.5
+// In-flight bytes kept relative to the BDP, below the inflation limit
+#define TUNER_BDP_HEADROOM 1.25
+// Once settled, grow by this factor while the RTT stays near its minimum and
+// throughput still rises: the window rather than the path is the limit
+#define TUNER_RTT_IDLE 1.1
+#define TUNER_STEADY_GROWTH 1.25
+#define TUNER_STEADY_GAIN 1.01
+
+static void record(ChunkTuner *tuner, size_t chunk_size, ChunkTuneReason reason, double rate)
+{
+    tuner->chunk_size = chunk_size;
+    if (tuner->num_events < CHUNK_TUNER_MAX_EVENTS)
+    {
+        ChunkTuneEvent *event = &tuner->events[tuner->num_events++];
+        event->step = tuner->step;
+        event->chunk_size = chunk_size;
+        event->reason = reason;
+        event->rtt = tuner->srtt;
+        event->rate = rate;
+    }
+}
+
+static size_t clamp_size(double size)
+{
+    if (size < CHUNK_MIN_SIZE)
+        return CHUNK_MIN_SIZE;
+    if (size > CHUNK_MAX_SIZE)
+        return CHUNK_MAX_SIZE;
+    return (size_t)size;
+}
+
+// Chunk size that keeps the bandwidth-delay product plus some headroom in flight
+static size_t bdp_target(const ChunkTuner *tuner, double rate)
+{
+    double bdp_bytes = rate / 8.0 * tuner->min_rtt;
+    return clamp_size(TUNER_BDP_HEADROOM * bdp_bytes / tuner->window);
+}
+
+void chunk_tuner_init(ChunkTuner *tuner, int window)
+{
+    memset(tuner, 0, sizeof(ChunkTuner));
+    tuner->window = window;
+    tuner->probing = true;
+    estimator_init(&tuner->delivery, TUNER_RATE_WINDOW, TUNER_RATE_TAU);
+    record(tuner, CHUNK_MIN_SIZE, CHUNK_START, 0);
+}
+
+size_t chunk_tuner_size(const ChunkTuner *tuner)
+{
+    return tuner->chunk_size;
+}
+
+// Called for every ack: `bytes` newly delivered, `rtt` from sending the newest
+// acked chunk to its ack and `one_way_delay` its clock-corrected send-to-arrival time
+void chunk_tuner_on_ack(ChunkTuner *tuner, double now, double bytes, double rtt, double one_way_delay)
+{
+    if (rtt > 0)
+    {
+        tuner->min_rtt = (tuner->min_rtt == 0 || rtt < tuner->min_rtt) ? rtt : tuner->min_rtt;
+        tuner->srtt = (tuner->srtt == 0) ? rtt : 0.875 * tuner->srtt + 0.125 * rtt;
+    }
+    if (!tuner->has_delay)
+    {
+        tuner->base_delay = tuner->smoothed_delay = one_way_delay;
+        tuner->has_delay = true;
+    }
+    tuner->base_delay = (one_way_delay < tuner->base_delay) ? one_way_delay : tuner->base_delay;
+    tuner->smoothed_delay = 0.875 * tuner->smoothed_delay + 0.125 * one_way_delay;
+    if (tuner->last_ack_time > 0)
+    {
+        estimator_add(&tuner->delivery, now, bytes, now - tuner->last_ack_time);
+    }
+    tuner->last_ack_time = now;
+
+    // Judge a size only after it has been in use for at least one round trip
+    double interval = tuner->srtt > TUNER_MIN_INTERVAL ? tuner->srtt : TUNER_MIN_INTERVAL;
+    if (now - tuner->last_decision_time < interval || estimator_samples(&tuner->delivery) == 0)
+    {
+        return;
+    }
+    tuner->last_decision_time = now;
+    double rate = estimator_rate(&tuner->delivery);
+    size_t size = tuner->chunk_size;
+
+    // Only the rise over the base delay counts, a clock offset left in it cancels
+    double queue_delay = tuner->smoothed_delay - tuner->base_delay;
+    bool queueing = queue_delay > (TUNER_RTT_INFLATION - 1) * tuner->min_rtt;
+    if (queueing || tuner->srtt > TUNER_RTT_INFLATION * tuner->min_rtt)
+    {
+        // Smaller chunks keep the congestion telemetry fresh
+        tuner->probing = false;
+        if (size > CHUNK_MIN_SIZE)
+        {
+            record(tuner, clamp_size(size / 2.0), CHUNK_CONGESTION, rate);
+        }
+    }
+    else if (tuner->probing)
+    {
+        if (rate > tuner->last_rate * TUNER_PROBE_GAIN && size < CHUNK_MAX_SIZE)
+        {
+            record(tuner, clamp_size(size * 2.0), CHUNK_PROBE_UP, rate);
+        }
+        else
+        {
+            tuner->probing = false;
+            size_t target = bdp_target(tuner, rate);
+            record(tuner, target > size ? target : size, CHUNK_SETTLED, rate);
+        }
+    }
+    else
+    {
+        size_t target = bdp_target(tuner, rate);
+        if (tuner->srtt < TUNER_RTT_IDLE * tuner->min_rtt && rate > tuner->last_rate * TUNER_STEADY_GAIN && size < CHUNK_MAX_SIZE)
+        {
+            record(tuner, clamp_size(size * TUNER_STEADY_GROWTH), CHUNK_PROBE_UP, rate);
+        }
+        else if (target > 2 * size || 2 * target < size)
+        {
+            record(tuner, target, CHUNK_BDP_RETARGET, rate);
+        }
+    }
+    tuner->last_rate = rate;
+}
+
+// Tag the following decisions with a new step, the current size carries over
+void chunk_tuner_begin_step(ChunkTuner *tuner, int step)
+{
+    tuner->step = step;
+}
+
+// Drop the decisions once they have been exported
+void chunk_tuner_clear_events(ChunkTuner *tuner)
+{
+    tuner->num_events = 0;
+}
+
+const char *chunk_tune_reason_name(ChunkTuneReason reason)
+{
+    switch (reason)
+    {
+    case CHUNK_START:
+        return "start";
+    case CHUNK_PROBE_UP:
+        return "probe_up";
+    case CHUNK_SETTLED:
+        return "settled";
+    case CHUNK_BDP_RETARGET:
+        return "bdp_retarget";
+    case CHUNK_CONGESTION:
+        return "congestion";
+    }
+    return "unknown";
+}
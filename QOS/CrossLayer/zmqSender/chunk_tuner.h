@@ -0,0 +1,64 @@
+#ifndef CHUNK_TUNER_H
+#define CHUNK_TUNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "estimator.h"
+
+#define CHUNK_MIN_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (64 * 1024 * 1024)
+// Size changes kept for export until the next step boundary
+#define CHUNK_TUNER_MAX_EVENTS 64
+
+typedef enum
+{
+    CHUNK_START,        // initial size
+    CHUNK_PROBE_UP,     // throughput still rising, double
+    CHUNK_SETTLED,      // throughput flat, hold at the bandwidth-delay product
+    CHUNK_BDP_RETARGET, // RTT or throughput moved the BDP target
+    CHUNK_CONGESTION    // queueing delay on the path, halve
+} ChunkTuneReason;
+
+typedef struct
+{
+    int step;
+    size_t chunk_size;
+    ChunkTuneReason reason;
+    double rtt;
+    double rate;
+} ChunkTuneEvent;
+
+// Per-stream chunk-size controller. Starts at CHUNK_MIN_SIZE, doubles while
+// throughput keeps improving, then tracks the size that keeps `window` chunks
+// covering the bandwidth-delay product, and halves when the RTT or the
+// one-way delay shows a queue building on the path.
+typedef struct
+{
+    size_t chunk_size;
+    int window;
+    bool probing;
+    double min_rtt;
+    double srtt;
+    // One-way delay: the smallest seen is the propagation delay, the smoothed
+    // value above it the queue at the bottleneck
+    double base_delay;
+    double smoothed_delay;
+    bool has_delay;
+    double last_ack_time;
+    double last_decision_time;
+    double last_rate;
+    ThroughputEstimator delivery;
+
+    int step;
+    ChunkTuneEvent events[CHUNK_TUNER_MAX_EVENTS];
+    int num_events;
+} ChunkTuner;
+
+void chunk_tuner_init(ChunkTuner *tuner, int window);
+size_t chunk_tuner_size(const ChunkTuner *tuner);
+void chunk_tuner_on_ack(ChunkTuner *tuner, double now, double bytes, double rtt, double one_way_delay);
+void chunk_tuner_begin_step(ChunkTuner *tuner, int step);
+void chunk_tuner_clear_events(ChunkTuner *tuner);
+const char *chunk_tune_reason_name(ChunkTuneReason reason);
+
+#endif // CHUNK_TUNER_H
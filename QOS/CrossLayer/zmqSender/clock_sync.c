@@ -0,0 +1,43 @@
+#include <string.h>
+#include "clock_sync.h"
+
+void clock_sync_init(ClockSync *sync)
+{
+    memset(sync, 0, sizeof(ClockSync));
+}
+
+// Difference of two nanosecond stamps as signed seconds
+static double ns_diff(uint64_t later, uint64_t earlier)
+{
+    return (double)(int64_t)(later - earlier) / 1e9;
+}
+
+// t1, t4 on the sender's clock, t2, t3 on the receiver's
+void clock_sync_update(ClockSync *sync, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+{
+    if (t1 == 0 || t2 == 0 || t3 == 0)
+    {
+        return;
+    }
+    double rtt = ns_diff(t4, t1) - ns_diff(t3, t2);
+    if (rtt < 0)
+    {
+        return;
+    }
+    double now = (double)t4 / 1e9;
+    sync->samples++;
+    if (!sync->valid || rtt <= sync->rtt || now - sync->sampled_at > CLOCK_SYNC_WINDOW)
+    {
+        sync->offset = (ns_diff(t2, t1) + ns_diff(t3, t4)) / 2;
+        sync->rtt = rtt;
+        sync->sampled_at = now;
+        sync->valid = true;
+    }
+}
+
+// Correct a receiver-computed arrival minus send time for the clock offset.
+// Before the first ack there is no offset yet and the raw value is returned.
+double clock_sync_one_way_delay(const ClockSync *sync, double raw_delay)
+{
+    return sync->valid ? raw_delay - sync->offset : raw_delay;
+}
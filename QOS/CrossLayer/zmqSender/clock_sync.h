@@ -0,0 +1,30 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Seconds a minimum-RTT offset sample stays authoritative before a worse one may replace it
+#ifndef CLOCK_SYNC_WINDOW
+#define CLOCK_SYNC_WINDOW 10.0
+#endif
+
+// Offset between the receiver's and the sender's CLOCK_MONOTONIC, estimated
+// in-band from chunk acks the way NTP does: the ack echoes the send (t1) and
+// arrival (t2) stamps of a chunk, its own frame header carries t3 and the
+// sender stamps t4 when it arrives. The sample with the smallest round trip
+// in the window has the least queueing in it and wins.
+typedef struct
+{
+    double offset; // receiver clock minus sender clock, seconds
+    double rtt;    // round trip of the sample the offset came from
+    double sampled_at;
+    uint64_t samples;
+    bool valid;
+} ClockSync;
+
+void clock_sync_init(ClockSync *sync);
+void clock_sync_update(ClockSync *sync, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+double clock_sync_one_way_delay(const ClockSync *sync, double raw_delay);
+
+#endif // CLOCK_SYNC_H
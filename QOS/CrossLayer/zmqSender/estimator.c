@@ -0,0 +1,124 @@
+#include <math.h>
+#include <string.h>
+#include "estimator.h"
+
+static int rate_bucket(double rate)
+{
+    if (rate <= ESTIMATOR_MIN_RATE)
+    {
+        return 0;
+    }
+    int bucket = (int)(log10(rate / ESTIMATOR_MIN_RATE) * ESTIMATOR_BUCKETS_PER_DECADE);
+    return bucket < ESTIMATOR_BUCKETS ? bucket : ESTIMATOR_BUCKETS - 1;
+}
+
+// Geometric centre of a histogram bucket in bits/s
+static double bucket_rate(int bucket)
+{
+    return ESTIMATOR_MIN_RATE * pow(10.0, (bucket + 0.5) / ESTIMATOR_BUCKETS_PER_DECADE);
+}
+
+static void drop_oldest(ThroughputEstimator *est)
+{
+    EstimatorSample *oldest = &est->samples[est->first];
+    est->sum_bytes -= oldest->bytes;
+    est->sum_seconds -= oldest->seconds;
+    est->histogram[oldest->bucket] -= oldest->bytes;
+    est->first = (est->first + 1) % ESTIMATOR_MAX_SAMPLES;
+    est->count--;
+    if (est->count == 0)
+    {
+        // Clear accumulated rounding error whenever the window drains
+        est->sum_bytes = 0;
+        est->sum_seconds = 0;
+        memset(est->histogram, 0, sizeof(est->histogram));
+    }
+}
+
+void estimator_init(ThroughputEstimator *est, double window_seconds, double ewma_tau)
+{
+    memset(est, 0, sizeof(ThroughputEstimator));
+    est->window_seconds = window_seconds;
+    est->ewma_tau = ewma_tau;
+}
+
+// Add one completed chunk: `bytes` moved in `seconds`, finishing at end_time
+void estimator_add(ThroughputEstimator *est, double end_time, double bytes, double seconds)
+{
+    if (seconds <= 0 || bytes <= 0)
+    {
+        return;
+    }
+    if (est->count == ESTIMATOR_MAX_SAMPLES)
+    {
+        drop_oldest(est);
+    }
+    double rate = bytes * 8 / seconds;
+    EstimatorSample *sample = &est->samples[(est->first + est->count) % ESTIMATOR_MAX_SAMPLES];
+    sample->end_time = end_time;
+    sample->bytes = bytes;
+    sample->seconds = seconds;
+    sample->bucket = rate_bucket(rate);
+    est->count++;
+    est->sum_bytes += bytes;
+    est->sum_seconds += seconds;
+    est->histogram[sample->bucket] += bytes;
+
+    // Weight each sample by the time it covers, a tiny chunk barely moves the average
+    if (!est->has_ewma)
+    {
+        est->ewma_rate = rate;
+        est->has_ewma = true;
+    }
+    else
+    {
+        double alpha = 1.0 - exp(-seconds / est->ewma_tau);
+        est->ewma_rate += alpha * (rate - est->ewma_rate);
+    }
+    estimator_expire(est, end_time);
+}
+
+void estimator_expire(ThroughputEstimator *est, double now)
+{
+    while (est->count > 0 && est->samples[est->first].end_time < now - est->window_seconds)
+    {
+        drop_oldest(est);
+    }
+}
+
+size_t estimator_samples(const ThroughputEstimator *est)
+{
+    return est->count;
+}
+
+// Time-weighted throughput over the window in bits/s: total bytes over total
+// transfer time, so every second of transfer counts the same regardless of chunk size
+double estimator_rate(const ThroughputEstimator *est)
+{
+    return est->sum_seconds > 0 ? est->sum_bytes * 8 / est->sum_seconds : 0;
+}
+
+double estimator_ewma(const ThroughputEstimator *est)
+{
+    return est->has_ewma ? est->ewma_rate : 0;
+}
+
+// Byte-weighted rate percentile (0-100) over the window in bits/s
+double estimator_percentile(const ThroughputEstimator *est, double percentile)
+{
+    if (est->count == 0 || est->sum_bytes <= 0)
+    {
+        return 0;
+    }
+    double target = est->sum_bytes * percentile / 100.0;
+    double seen = 0;
+    for (int i = 0; i < ESTIMATOR_BUCKETS; i++)
+    {
+        seen += est->histogram[i];
+        if (seen >= target && est->histogram[i] > 0)
+        {
+            return bucket_rate(i);
+        }
+    }
+    return bucket_rate(ESTIMATOR_BUCKETS - 1);
+}
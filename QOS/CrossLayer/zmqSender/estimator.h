@@ -0,0 +1,48 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of chunk samples held inside one window
+#define ESTIMATOR_MAX_SAMPLES 1024
+// Rate histogram: 8 log-spaced buckets per decade from 100 kbit/s to 100 Gbit/s
+#define ESTIMATOR_MIN_RATE 1e5
+#define ESTIMATOR_BUCKETS_PER_DECADE 8
+#define ESTIMATOR_BUCKETS (6 * ESTIMATOR_BUCKETS_PER_DECADE)
+
+typedef struct
+{
+    double end_time;
+    double bytes;
+    double seconds;
+    int bucket;
+} EstimatorSample;
+
+// Sliding-window throughput estimator for one stream. Every update is O(1):
+// samples enter at the tail, expire from the head, and the running sums and
+// histogram are adjusted by exactly the samples that enter or leave.
+typedef struct
+{
+    EstimatorSample samples[ESTIMATOR_MAX_SAMPLES];
+    size_t first;
+    size_t count;
+    double window_seconds;
+    double ewma_tau;
+    double sum_bytes;
+    double sum_seconds;
+    double histogram[ESTIMATOR_BUCKETS]; // bytes per rate bucket
+    double ewma_rate;
+    bool has_ewma;
+} ThroughputEstimator;
+
+void estimator_init(ThroughputEstimator *est, double window_seconds, double ewma_tau);
+void estimator_add(ThroughputEstimator *est, double end_time, double bytes, double seconds);
+void estimator_expire(ThroughputEstimator *est, double now);
+size_t estimator_samples(const ThroughputEstimator *est);
+double estimator_rate(const ThroughputEstimator *est);
+double estimator_ewma(const ThroughputEstimator *est);
+double estimator_percentile(const ThroughputEstimator *est, double percentile);
+
+#endif // ESTIMATOR_H
@@ -0,0 +1,438 @@
+#define _GNU_SOURCE // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "file_reader.h"
+
+_Static_assert(READER_BUFFER_SIZE % READER_ALIGNMENT == 0, "READER_BUFFER_SIZE must be a multiple of READER_ALIGNMENT");
+
+// No liburing on the nodes, the ring is driven with the raw system calls
+static int io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static size_t align_up(size_t size)
+{
+    return (size + READER_ALIGNMENT - 1) & ~((size_t)READER_ALIGNMENT - 1);
+}
+
+static void uring_teardown(FileReader *reader);
+
+static bool uring_setup(FileReader *reader)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    reader->ring_fd = io_uring_setup(READER_QUEUE_DEPTH, &params);
+    if (reader->ring_fd < 0)
+    {
+        return false;
+    }
+
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        if (reader->cq_ring_size > reader->sq_ring_size)
+            reader->sq_ring_size = reader->cq_ring_size;
+        reader->cq_ring_size = reader->sq_ring_size;
+    }
+    reader->sq_ring = mmap(NULL, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ring_fd, IORING_OFF_SQ_RING);
+    if (reader->sq_ring == MAP_FAILED)
+    {
+        reader->sq_ring = NULL;
+        return false;
+    }
+    reader->cq_ring = single_mmap ? reader->sq_ring
+                                  : mmap(NULL, reader->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ring_fd, IORING_OFF_CQ_RING);
+    if (reader->cq_ring == MAP_FAILED)
+    {
+        reader->cq_ring = NULL;
+        return false;
+    }
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes = mmap(NULL, reader->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ring_fd, IORING_OFF_SQES);
+    if (reader->sqes == MAP_FAILED)
+    {
+        reader->sqes = NULL;
+        return false;
+    }
+
+    char *sq = reader->sq_ring;
+    char *cq = reader->cq_ring;
+    reader->sq_head = (unsigned *)(sq + params.sq_off.head);
+    reader->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    reader->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    reader->sq_array = (unsigned *)(sq + params.sq_off.array);
+    reader->cq_head = (unsigned *)(cq + params.cq_off.head);
+    reader->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    reader->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    reader->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Registered buffers skip the per-read page pinning, they count against
+    // RLIMIT_MEMLOCK on older kernels so plain readv stays as a fallback
+    for (int i = 0; i < READER_QUEUE_DEPTH; i++)
+    {
+        reader->iovecs[i].iov_base = reader->buffers[i].data;
+        reader->iovecs[i].iov_len = READER_BUFFER_SIZE;
+    }
+    reader->registered = io_uring_register(reader->ring_fd, IORING_REGISTER_BUFFERS, reader->iovecs, READER_QUEUE_DEPTH) == 0;
+    return true;
+}
+
+// Move completions to their buffers, waiting for at least one when wait is set
+static int reap_completions(FileReader *reader, bool wait)
+{
+    if (wait && io_uring_enter(reader->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+    {
+        perror("io_uring_enter");
+        return -1;
+    }
+    unsigned head = *reader->cq_head;
+    unsigned tail = atomic_load_explicit((_Atomic unsigned *)reader->cq_tail, memory_order_acquire);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &reader->cqes[head & *reader->cq_mask];
+        ReaderBuffer *buffer = &reader->buffers[cqe->user_data];
+        buffer->result = cqe->res < 0 ? cqe->res : 0;
+        buffer->length = cqe->res < 0 ? 0 : (size_t)cqe->res;
+        atomic_store_explicit(&buffer->state, READER_DONE, memory_order_release);
+        reader->inflight--;
+        head++;
+    }
+    atomic_store_explicit((_Atomic unsigned *)reader->cq_head, head, memory_order_release);
+    return 0;
+}
+
+static void uring_teardown(FileReader *reader)
+{
+    if (reader->ring_fd < 0)
+    {
+        return;
+    }
+    // The kernel may still write into the pool until the reads complete
+    while (reader->inflight > 0 && reap_completions(reader, true) == 0)
+    {
+    }
+    if (reader->sqes)
+        munmap(reader->sqes, reader->sqes_size);
+    if (reader->cq_ring && reader->cq_ring != reader->sq_ring)
+        munmap(reader->cq_ring, reader->cq_ring_size);
+    if (reader->sq_ring)
+        munmap(reader->sq_ring, reader->sq_ring_size);
+    close(reader->ring_fd);
+    reader->ring_fd = -1;
+    reader->sqes = NULL;
+    reader->sq_ring = NULL;
+    reader->cq_ring = NULL;
+}
+
+static void queue_read(FileReader *reader, int slot)
+{
+    ReaderBuffer *buffer = &reader->buffers[slot];
+    unsigned tail = *reader->sq_tail;
+    unsigned index = tail & *reader->sq_mask;
+    struct io_uring_sqe *sqe = &reader->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = reader->fd;
+    sqe->off = buffer->offset;
+    sqe->user_data = slot;
+    if (reader->registered)
+    {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)buffer->data;
+        sqe->len = buffer->length;
+        sqe->buf_index = slot;
+    }
+    else
+    {
+        reader->iovecs[slot].iov_len = buffer->length;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)&reader->iovecs[slot];
+        sqe->len = 1;
+    }
+    reader->sq_array[index] = index;
+    atomic_store_explicit((_Atomic unsigned *)reader->sq_tail, tail + 1, memory_order_release);
+}
+
+// Queue reads into every free buffer up to READER_QUEUE_DEPTH ahead of the consumer
+static void submit_reads(FileReader *reader)
+{
+    unsigned to_submit = 0;
+    while (reader->submitted - reader->delivered < READER_QUEUE_DEPTH && reader->submit_offset < reader->file_size)
+    {
+        int slot = reader->submitted % READER_QUEUE_DEPTH;
+        ReaderBuffer *buffer = &reader->buffers[slot];
+        if (atomic_load_explicit(&buffer->state, memory_order_acquire) != READER_FREE)
+        {
+            break;
+        }
+        uint64_t remaining = reader->file_size - reader->submit_offset;
+        buffer->offset = reader->submit_offset;
+        buffer->requested = remaining < reader->read_size ? remaining : reader->read_size;
+        buffer->length = reader->direct ? align_up(buffer->requested) : buffer->requested;
+        buffer->result = 0;
+        atomic_store_explicit(&buffer->state, READER_INFLIGHT, memory_order_relaxed);
+        reader->submit_offset += buffer->requested;
+        reader->submitted++;
+        if (reader->ring_fd >= 0)
+        {
+            queue_read(reader, slot);
+            reader->inflight++;
+            to_submit++;
+        }
+    }
+    while (to_submit > 0)
+    {
+        int consumed = io_uring_enter(reader->ring_fd, to_submit, 0, 0);
+        if (consumed < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                // Make room by collecting finished reads, then retry
+                reap_completions(reader, false);
+                continue;
+            }
+            // The queued reads never reach the kernel, the ones it took are
+            // waited for, then every buffer in flight is read with pread
+            perror("io_uring_enter");
+            reader->inflight -= to_submit;
+            uring_teardown(reader);
+            return;
+        }
+        to_submit -= consumed;
+    }
+}
+
+// pread fallback, also used to finish a read the ring completed short
+static void read_sync(FileReader *reader, ReaderBuffer *buffer, size_t done)
+{
+    size_t length = reader->direct ? align_up(buffer->requested) : buffer->requested;
+    while (done < buffer->requested)
+    {
+        // O_DIRECT needs an aligned offset and length, the rest of a short
+        // read is read again from its last aligned boundary
+        size_t start = reader->direct ? done & ~((size_t)READER_ALIGNMENT - 1) : done;
+        ssize_t bytes = pread(reader->fd, buffer->data + start, length - start, buffer->offset + start);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            buffer->result = -errno;
+            break;
+        }
+        if (start + bytes <= done)
+        {
+            break;
+        }
+        done = start + bytes;
+    }
+    buffer->length = done;
+}
+
+FileReader *file_reader_open(const char *path)
+{
+    int fd = -1;
+    bool direct = false;
+#if READER_DIRECT_IO
+    // tmpfs and some network file systems refuse O_DIRECT
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+    direct = fd >= 0;
+#endif
+    if (fd < 0)
+    {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0)
+    {
+        perror("Failed to open file");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Failed to stat file");
+        close(fd);
+        return NULL;
+    }
+
+    FileReader *reader = calloc(1, sizeof(FileReader));
+    if (reader == NULL || posix_memalign((void **)&reader->pool, READER_ALIGNMENT, (size_t)READER_QUEUE_DEPTH * READER_BUFFER_SIZE) != 0)
+    {
+        perror("Failed to allocate read buffers");
+        free(reader);
+        close(fd);
+        return NULL;
+    }
+    reader->fd = fd;
+    reader->direct = direct;
+    reader->file_size = st.st_size;
+    reader->read_size = READER_BUFFER_SIZE;
+    reader->ring_fd = -1;
+    atomic_init(&reader->refs, 1);
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->released, NULL);
+    for (int i = 0; i < READER_QUEUE_DEPTH; i++)
+    {
+        reader->buffers[i].reader = reader;
+        reader->buffers[i].data = reader->pool + (size_t)i * READER_BUFFER_SIZE;
+        atomic_init(&reader->buffers[i].state, READER_FREE);
+    }
+
+    if (!uring_setup(reader))
+    {
+        uring_teardown(reader);
+        reader->ring_fd = -1;
+    }
+    if (!direct)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        // Without the ring nothing reads ahead of the consumer but the page cache
+        if (reader->ring_fd < 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        }
+    }
+    // Start filling the buffers right away
+    submit_reads(reader);
+    return reader;
+}
+
+// Size of the reads queued from now on, at most READER_BUFFER_SIZE
+void file_reader_set_read_size(FileReader *reader, size_t size)
+{
+    if (size > READER_BUFFER_SIZE)
+        size = READER_BUFFER_SIZE;
+    if (size == 0)
+        size = 1;
+    reader->read_size = reader->direct ? align_up(size) : size;
+}
+
+bool file_reader_uses_uring(const FileReader *reader)
+{
+    return reader->ring_fd >= 0;
+}
+
+// Hand out the next buffer of the file in order. The caller owns it until
+// file_reader_release. Returns false at the end of the file or on a read error.
+bool file_reader_next(FileReader *reader, ReaderBuffer **out)
+{
+    while (true)
+    {
+        submit_reads(reader);
+        if (reader->delivered < reader->submitted)
+        {
+            break;
+        }
+        if (reader->submit_offset >= reader->file_size)
+        {
+            return false;
+        }
+        // Every buffer is still held downstream, wait for the next one to come back
+        ReaderBuffer *next = &reader->buffers[reader->submitted % READER_QUEUE_DEPTH];
+        pthread_mutex_lock(&reader->lock);
+        reader->buffer_waits++;
+        while (atomic_load_explicit(&next->state, memory_order_acquire) != READER_FREE)
+        {
+            pthread_cond_wait(&reader->released, &reader->lock);
+        }
+        pthread_mutex_unlock(&reader->lock);
+    }
+
+    ReaderBuffer *buffer = &reader->buffers[reader->delivered % READER_QUEUE_DEPTH];
+    if (reader->ring_fd >= 0)
+    {
+        if (atomic_load_explicit(&buffer->state, memory_order_acquire) != READER_DONE)
+        {
+            reader->io_waits++;
+        }
+        while (atomic_load_explicit(&buffer->state, memory_order_acquire) != READER_DONE)
+        {
+            if (reap_completions(reader, true) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    // Reads the ring completed before it was torn down are kept
+    if (atomic_load_explicit(&buffer->state, memory_order_acquire) == READER_DONE)
+    {
+        if (buffer->result == 0 && buffer->length < buffer->requested)
+        {
+            read_sync(reader, buffer, buffer->length);
+        }
+    }
+    else
+    {
+        read_sync(reader, buffer, 0);
+    }
+    if (buffer->result < 0)
+    {
+        fprintf(stderr, "Failed to read at offset %llu: %s\n", (unsigned long long)buffer->offset, strerror(-buffer->result));
+        return false;
+    }
+    if (buffer->length > buffer->requested)
+    {
+        buffer->length = buffer->requested;
+    }
+    if (buffer->length == 0)
+    {
+        // The file shrank under us
+        return false;
+    }
+
+    atomic_store_explicit(&buffer->state, READER_HELD, memory_order_relaxed);
+    atomic_fetch_add(&reader->refs, 1);
+    reader->delivered++;
+    // Keep the queue full while the caller sends this one
+    submit_reads(reader);
+    *out = buffer;
+    return true;
+}
+
+static void file_reader_unref(FileReader *reader)
+{
+    if (atomic_fetch_sub(&reader->refs, 1) == 1)
+    {
+        pthread_mutex_destroy(&reader->lock);
+        pthread_cond_destroy(&reader->released);
+        free(reader->pool);
+        free(reader);
+    }
+}
+
+// Give a buffer back, safe to call from any thread
+void file_reader_release(ReaderBuffer *buffer)
+{
+    FileReader *reader = buffer->reader;
+    pthread_mutex_lock(&reader->lock);
+    atomic_store_explicit(&buffer->state, READER_FREE, memory_order_release);
+    pthread_cond_signal(&reader->released);
+    pthread_mutex_unlock(&reader->lock);
+    file_reader_unref(reader);
+}
+
+// Stop reading, buffers still held elsewhere stay valid until released
+void file_reader_close(FileReader *reader)
+{
+    uring_teardown(reader);
+    close(reader->fd);
+    file_reader_unref(reader);
+}
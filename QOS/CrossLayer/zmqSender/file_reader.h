@@ -0,0 +1,103 @@
+#ifndef FILE_READER_H
+#define FILE_READER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Reads kept in flight per file
+#ifndef READER_QUEUE_DEPTH
+#define READER_QUEUE_DEPTH 8
+#endif
+
+// Capacity of each registered buffer, larger chunks are handed out as several buffers
+#ifndef READER_BUFFER_SIZE
+#define READER_BUFFER_SIZE (1024 * 1024)
+#endif
+
+// 1: open with O_DIRECT (reads bypass the page cache), 0: buffered reads with readahead hints
+#ifndef READER_DIRECT_IO
+#define READER_DIRECT_IO 0
+#endif
+
+// Buffer, offset and length alignment for O_DIRECT
+#define READER_ALIGNMENT 4096
+
+typedef struct FileReader FileReader;
+
+typedef enum
+{
+    READER_FREE,     // may be submitted
+    READER_INFLIGHT, // read submitted to the kernel
+    READER_DONE,     // read completed, not handed out yet
+    READER_HELD      // owned by the caller until file_reader_release
+} ReaderBufferState;
+
+typedef struct
+{
+    FileReader *reader;
+    char *data;
+    uint64_t offset;
+    size_t requested; // bytes of the file this buffer covers
+    size_t length;    // bytes asked from the kernel, then bytes read
+    int result;       // negative errno of a failed read
+    _Atomic int state;
+} ReaderBuffer;
+
+// Sequential reader of one file that keeps up to READER_QUEUE_DEPTH reads in
+// flight ahead of the consumer. Uses io_uring with registered buffers when the
+// kernel allows it, otherwise pread into the same buffers when they are handed out.
+// Buffers may be released from any thread (e.g. a ZeroMQ free callback); the
+// reader stays allocated until the owner closed it and every buffer is back.
+struct FileReader
+{
+    int fd;
+    bool direct;
+    uint64_t file_size;
+    size_t read_size;
+    uint64_t submit_offset;
+    uint64_t submitted; // buffers submitted, buffer i lives in slot i % READER_QUEUE_DEPTH
+    uint64_t delivered; // buffers handed out
+    char *pool;
+    ReaderBuffer buffers[READER_QUEUE_DEPTH];
+    atomic_int refs;
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+
+    // io_uring state, ring_fd < 0 when falling back to pread
+    int ring_fd;
+    bool registered;
+    int inflight;
+    struct iovec iovecs[READER_QUEUE_DEPTH];
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Times file_reader_next had to wait for the disk, and for a buffer to come back
+    uint64_t io_waits;
+    uint64_t buffer_waits;
+};
+
+FileReader *file_reader_open(const char *path);
+void file_reader_set_read_size(FileReader *reader, size_t size);
+bool file_reader_next(FileReader *reader, ReaderBuffer **buffer);
+void file_reader_release(ReaderBuffer *buffer);
+void file_reader_close(FileReader *reader);
+bool file_reader_uses_uring(const FileReader *reader);
+
+#endif // FILE_READER_H
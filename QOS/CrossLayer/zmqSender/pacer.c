@@ -0,0 +1,69 @@
+#include <errno.h>
+#include <time.h>
+#include "pacer.h"
+
+static double monotonic_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double deadline)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+void pacer_init(Pacer *pacer, uint64_t rate, double burst)
+{
+    atomic_init(&pacer->rate, rate);
+    pacer->burst = burst < PACER_SLICE_SIZE ? PACER_SLICE_SIZE : burst;
+    pacer->tokens = pacer->burst;
+    pacer->last_refill = monotonic_now();
+}
+
+void pacer_set_rate(Pacer *pacer, uint64_t rate)
+{
+    atomic_store_explicit(&pacer->rate, rate, memory_order_relaxed);
+}
+
+uint64_t pacer_get_rate(Pacer *pacer)
+{
+    return atomic_load_explicit(&pacer->rate, memory_order_relaxed);
+}
+
+// Block until `bytes` may be sent. The rate is re-read on every wakeup so a
+// change takes effect on the next slice.
+void pacer_wait(Pacer *pacer, size_t bytes)
+{
+    double needed = bytes < pacer->burst ? bytes : pacer->burst;
+    while (1)
+    {
+        double now = monotonic_now();
+        uint64_t rate = pacer_get_rate(pacer);
+        if (rate == 0)
+        {
+            pacer->tokens = pacer->burst;
+            pacer->last_refill = now;
+            return;
+        }
+        double bytes_per_second = rate / 8.0;
+        pacer->tokens += (now - pacer->last_refill) * bytes_per_second;
+        pacer->last_refill = now;
+        if (pacer->tokens > pacer->burst)
+        {
+            pacer->tokens = pacer->burst;
+        }
+        if (pacer->tokens >= needed)
+        {
+            pacer->tokens -= bytes;
+            return;
+        }
+        sleep_until(now + (needed - pacer->tokens) / bytes_per_second);
+    }
+}
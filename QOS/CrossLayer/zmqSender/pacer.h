@@ -0,0 +1,26 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunks are split into frames of this size and each frame is paced separately
+#define PACER_SLICE_SIZE (64 * 1024)
+
+// Token bucket for one stream. The rate can be changed from any thread, the
+// bucket itself is only touched by the thread that sends the stream.
+typedef struct
+{
+    _Atomic uint64_t rate; // bits/s, 0 = unlimited
+    double tokens;         // bytes
+    double burst;          // bytes
+    double last_refill;    // CLOCK_MONOTONIC seconds
+} Pacer;
+
+void pacer_init(Pacer *pacer, uint64_t rate, double burst);
+void pacer_set_rate(Pacer *pacer, uint64_t rate);
+uint64_t pacer_get_rate(Pacer *pacer);
+void pacer_wait(Pacer *pacer, size_t bytes);
+
+#endif // PACER_H
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Exercise the netlink tc backend inside a throwaway network namespace.
+# Usage: sudo ./netns_tc_check.sh [path/to/tcctl]
+
+TCCTL="${1:-../build/tcctl}"
+NS="tcctl_check"
+
+if [[ ! -x "$TCCTL" ]]; then
+    echo "tcctl not found at $TCCTL. Build the sender first."
+    exit 1
+fi
+
+cleanup() {
+    ip netns del "$NS" 2>/dev/null
+}
+trap cleanup EXIT
+
+# veth pair inside a private namespace, nothing on the host is touched
+ip netns add "$NS" || exit 1
+ip -n "$NS" link add veth0 type veth peer name veth1 || exit 1
+ip -n "$NS" link set veth0 up
+ip -n "$NS" link set veth1 up
+
+check_rate() {
+    local classid="$1"
+    local expected="$2"
+    if ! tc -n "$NS" class show dev veth0 | grep "class htb $classid " | grep -q "rate $expected "; then
+        echo "FAIL: class $classid is not at $expected"
+        tc -n "$NS" class show dev veth0
+        exit 1
+    fi
+}
+
+# First call creates the qdisc and classes, later calls only change rates
+ip netns exec "$NS" "$TCCTL" veth0 100000000 50000000 || exit 1
+check_rate 1:1 100Mbit
+check_rate 1:2 50Mbit
+
+ip netns exec "$NS" "$TCCTL" veth0 20000000 180000000 || exit 1
+check_rate 1:1 20Mbit
+check_rate 1:2 180Mbit
+
+for i in $(seq 1 10); do
+    ip netns exec "$NS" "$TCCTL" veth0 $((i * 10000000)) $((200000000 - i * 10000000)) | tail -n 1
+done
+check_rate 1:1 100Mbit
+check_rate 1:2 100Mbit
+
+echo "netlink tc backend OK"
@@ -10,48 +10,124 @@
 #include <arpa/inet.h>
 #include <stdbool.h>
 #include <time.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <errno.h>
+#include "protocol.h"
+#include "frame.h"
+#include "clock_sync.h"
+#include "telemetry.h"
+#include "estimator.h"
+#include "tc_netlink.h"
+#include "pacer.h"
+#include "chunk_tuner.h"
+#include "streams.h"
+#include "step_queue.h"
+#include "step_state.h"
+#include "file_reader.h"
 
 #define BASE_PORT 4444
 #define CLIENT_IP "RECEIVER_IP"
-#define NUM_STEPS 1
 #define BANDWIDTH_SIZE 100
 #define LINK_BANDWIDTH 200.0 * 1000.0 * 1000.0
 
-typedef enum
-{
-    LOW,
-    HIGH
-} SocketPriority;
+// Congestion estimator: throughput window, EWMA time constant and the
+// deadline that refreshes the estimate when no samples arrive
+#define CONGESTION_WINDOW_SECONDS 2.0
+#define CONGESTION_EWMA_TAU 0.5
+#define CONGESTION_TICK_MS 250
 
-typedef enum
-{
-    REDUCED,
-    AUG
-} FilesType;
+// Interface whose HTB classes 1:1 .. 1:N (one per stream) are driven over netlink
+#define TC_INTERFACE "enp7s0"
+#define TC_MIN_RATE 100000
+
+// 1: mmap every input file once and hand slices of the mapping to ZeroMQ,
+// 0: read ahead into a pool of buffers with io_uring (pread without it), see file_reader.h
+#ifndef ZERO_COPY_SEND
+#define ZERO_COPY_SEND 1
+#endif
+
+// Maximum number of chunks a stream may have in flight before it waits for an ack
+#ifndef SEND_WINDOW
+#define SEND_WINDOW 32
+#endif
+
+// 1: pace each stream in-process to the rate the congestion thread assigns it,
+// sending chunks as PACER_SLICE_SIZE messages
+#ifndef APP_PACING
+#define APP_PACING 0
+#endif
 
-// Global shared resources
-pthread_mutex_t bandwidth_mutex = PTHREAD_MUTEX_INITIALIZER;
-double time_taken[BANDWIDTH_SIZE][2] = {0};
-double bytes_sent[BANDWIDTH_SIZE][2] = {0};
-int reduced_index = 0;
-int aug_index = 0;
-volatile double dynamic_progress_threshold = 100.0;
-volatile double max_progress_per_step = 0;
+// Receiver analysis backlog, as a fraction of its queue, above which the
+// refinement data is trimmed; a full queue trims every file to
+// RECEIVER_BACKLOG_MIN_PROGRESS percent
+#ifndef RECEIVER_BACKLOG_START
+#define RECEIVER_BACKLOG_START 0.5
+#endif
+#ifndef RECEIVER_BACKLOG_MIN_PROGRESS
+#define RECEIVER_BACKLOG_MIN_PROGRESS 50.0
+#endif
+
+_Static_assert(ACK_BATCH <= SEND_WINDOW, "the receiver acks in batches of ACK_BATCH, the window must hold at least one batch");
+
+_Static_assert(MAX_STREAMS <= TC_MAX_CLASSES, "every stream needs its own HTB class");
+
+// Global shared resources, written by the sender threads and read by the
+// congestion thread without locking
+StreamTable stream_table;
+TelemetryRing stream_telemetry[MAX_STREAMS];
+Pacer stream_pacers[MAX_STREAMS];
+int telemetry_event_fd = -1;
+_Atomic double dynamic_progress_threshold = 100.0;
+_Atomic double max_progress_per_step = 0;
+// Analysis backlog the receiver reported with its last step ack
+_Atomic double receiver_backlog = 0;
 volatile bool stop_congestion_thread = false;
-volatile int active_file_index = 0;
-volatile double curr_reduced_file_size[NUM_STEPS] = {0};
-volatile double curr_aug_files_size[NUM_STEPS] = {0};
-volatile double aug_file_size = 0;
-volatile int step_aug = 0;
-volatile int step_reduced = 0;
+// Bytes each stream still has to send per step, and the step each stream is sending
+StepStateTable step_states;
+atomic_int stream_step[MAX_STREAMS];
 void *context;
 typedef struct
 {
-    char **filenames;
-    int num_files;
+    const StreamDescriptor *stream;
     int thread_index;
+    StepQueue *queue;
 } ThreadArgs;
 
+// Read-only mapping of one input file. Every chunk in flight holds a reference,
+// the owner holds one more until it is done with it, the last release unmaps.
+typedef struct
+{
+    char *data;
+    size_t size;
+    atomic_int refs;
+} MappedFile;
+
+// Credit state of one stream: chunks [acked, next_seq) are unacknowledged
+typedef struct
+{
+    uint64_t next_seq;
+    uint64_t acked;
+    double inflight_bytes[SEND_WINDOW];
+    double sent_at[SEND_WINDOW];
+    ChunkTuner *tuner;
+    ClockSync *clock;
+} SendWindow;
+
+// Files of one step, opened and read ahead by the prepare stage of a stream
+typedef struct
+{
+    int step;
+    FileReader *readers[MAX_STREAM_FILES];
+    MappedFile *maps[MAX_STREAM_FILES];
+    double sizes[MAX_STREAM_FILES];
+} PreparedStep;
+
 void start_net_layer()
 {
     pid_t pid = fork();
@@ -62,8 +138,16 @@ void start_net_layer()
     }
     else if (pid == 0)
     {
-        const char *script_path = "../scripts/NetLayer.py";
-        execlp("python3", "python3", script_path, "--dest_ip", CLIENT_IP, "--ports", "4444", "4445", NULL);
+        char ports[MAX_STREAMS][8];
+        char *argv[6 + MAX_STREAMS + 1] = {"python3", "../scripts/NetLayer.py", "--dest_ip", CLIENT_IP, "--ports"};
+        int argc = 5;
+        for (int i = 0; i < stream_table.num_streams; i++)
+        {
+            snprintf(ports[i], sizeof(ports[i]), "%d", stream_table.streams[i].port);
+            argv[argc++] = ports[i];
+        }
+        argv[argc] = NULL;
+        execvp("python3", argv);
         perror("Failed to execute Python script");
         exit(EXIT_FAILURE);
     }
@@ -73,15 +157,17 @@ void start_net_layer()
     }
 }
 
-void write_json(const char *file_path, int reduced_size, int aug_size, double link_bandwidth, double congestion)
+void write_json(const char *file_path, const double *stream_sizes, int num_streams, double link_bandwidth, double congestion)
 {
     // Create a JSON object
     json_object *root_obj = json_object_new_object();
 
     // Add to JSON object
     json_object *file_sizes = json_object_new_array();
-    json_object_array_add(file_sizes, json_object_new_int(reduced_size));
-    json_object_array_add(file_sizes, json_object_new_int(aug_size));
+    for (int i = 0; i < num_streams; i++)
+    {
+        json_object_array_add(file_sizes, json_object_new_int(stream_sizes[i]));
+    }
     json_object_object_add(root_obj, "file_sizes", file_sizes);
     json_object_object_add(root_obj, "link_bandwidth", json_object_new_int(link_bandwidth));
     json_object_object_add(root_obj, "congestion", json_object_new_int(congestion));
@@ -100,113 +186,424 @@ void write_json(const char *file_path, int reduced_size, int aug_size, double li
     json_object_put(root_obj);
 }
 
+double monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Split the link between the streams in proportion to weight * bytes each still has
+// to send in this step (with equal weights the policy NetLayer.py applies to
+// congestion.json). Shares outside a stream's [min_share, max_share] are pinned to the
+// bound and the rest is split again between the remaining streams.
+bool calculate_class_rates(const StreamTable *table, const double *demands, double link_bandwidth, double congestion, uint64_t *rates)
+{
+    int num_streams = table->num_streams;
+    double available_bandwidth = link_bandwidth - congestion;
+    double shares[MAX_STREAMS];
+    bool pinned[MAX_STREAMS];
+    double total_demand = 0;
+    for (int i = 0; i < num_streams; i++)
+    {
+        // Idle streams keep the minimum class rate and no reserved share
+        pinned[i] = demands[i] <= 0;
+        shares[i] = 0;
+        if (!pinned[i])
+        {
+            total_demand += table->streams[i].weight * demands[i];
+        }
+    }
+    if (total_demand <= 0 || available_bandwidth <= 0)
+    {
+        return false;
+    }
+
+    double free_share = 1.0;
+    for (int round = 0; round <= num_streams; round++)
+    {
+        double free_demand = 0;
+        for (int i = 0; i < num_streams; i++)
+        {
+            if (!pinned[i])
+            {
+                free_demand += table->streams[i].weight * demands[i];
+            }
+        }
+        if (free_demand <= 0)
+        {
+            break;
+        }
+        bool clamped = false;
+        for (int i = 0; i < num_streams; i++)
+        {
+            if (pinned[i])
+            {
+                continue;
+            }
+            const StreamDescriptor *stream = &table->streams[i];
+            shares[i] = free_share * stream->weight * demands[i] / free_demand;
+            // The last round only distributes, bounds already pinned stay pinned
+            if (round < num_streams && (shares[i] < stream->min_share || shares[i] > stream->max_share))
+            {
+                shares[i] = shares[i] < stream->min_share ? stream->min_share : stream->max_share;
+                pinned[i] = true;
+                clamped = true;
+            }
+        }
+        if (!clamped)
+        {
+            break;
+        }
+        free_share = 1.0;
+        for (int i = 0; i < num_streams; i++)
+        {
+            if (pinned[i])
+            {
+                free_share -= shares[i];
+            }
+        }
+        if (free_share < 0)
+        {
+            free_share = 0;
+        }
+    }
+
+    for (int i = 0; i < num_streams; i++)
+    {
+        double rate = shares[i] * available_bandwidth;
+        rates[i] = rate > 0 ? (uint64_t)rate : TC_MIN_RATE;
+    }
+    return true;
+}
+
+// One-way delay of a stream: the smallest seen is the propagation delay, the
+// smoothed current value above it is the queue at the bottleneck
+typedef struct
+{
+    double base;
+    double smoothed;
+    bool valid;
+} DelayTracker;
+
+// Feed the samples a stream published since the last call into its estimator
+void ingest_stream_samples(TelemetryRing *ring, uint64_t *consumed, ThroughputEstimator *estimator, DelayTracker *delay)
+{
+    ChunkSample samples[TELEMETRY_RING_SIZE];
+    size_t count = telemetry_ring_snapshot(ring, *consumed, samples, TELEMETRY_RING_SIZE, consumed);
+    for (size_t i = 0; i < count; i++)
+    {
+        estimator_add(estimator, samples[i].completed_at, samples[i].bytes, samples[i].seconds);
+        if (!delay->valid)
+        {
+            delay->base = delay->smoothed = samples[i].delay;
+            delay->valid = true;
+        }
+        delay->base = (samples[i].delay < delay->base) ? samples[i].delay : delay->base;
+        delay->smoothed += (samples[i].delay - delay->smoothed) / 8;
+    }
+}
+
+// Windowed rate while the stream is transferring, its last smoothed rate while it is idle
+double stream_speed(const ThroughputEstimator *estimator)
+{
+    return estimator_samples(estimator) > 0 ? estimator_rate(estimator) : estimator_ewma(estimator);
+}
+
 void *calculate_congestion(void *arg)
 {
+    int num_streams = stream_table.num_streams;
+    ThroughputEstimator estimators[MAX_STREAMS];
+    DelayTracker delays[MAX_STREAMS] = {0};
+    uint64_t consumed[MAX_STREAMS] = {0};
+    for (int i = 0; i < num_streams; i++)
+    {
+        estimator_init(&estimators[i], CONGESTION_WINDOW_SECONDS, CONGESTION_EWMA_TAU);
+    }
+
+    // Recompute on every batch of new samples, and at least every CONGESTION_TICK_MS
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    struct itimerspec tick = {
+        .it_interval = {0, CONGESTION_TICK_MS * 1000000L},
+        .it_value = {0, CONGESTION_TICK_MS * 1000000L}};
+    timerfd_settime(timer_fd, 0, &tick, NULL);
+    struct pollfd fds[2] = {
+        {.fd = telemetry_event_fd, .events = POLLIN},
+        {.fd = timer_fd, .events = POLLIN}};
+
+    // Apply class rates in-process when we may reconfigure tc, otherwise keep
+    // publishing congestion.json for NetLayer.py
+    TcNetlink tc;
+    uint64_t initial_rates[MAX_STREAMS];
+    for (int i = 0; i < num_streams; i++)
+    {
+        initial_rates[i] = LINK_BANDWIDTH / num_streams;
+    }
+    bool use_netlink = tc_netlink_open(&tc, TC_INTERFACE, num_streams) == 0 && tc_netlink_setup(&tc, initial_rates) == 0;
+    if (!use_netlink)
+    {
+        tc_netlink_close(&tc);
+        printf("Netlink tc backend unavailable, writing ../scripts/congestion.json\n");
+    }
 
     while (!stop_congestion_thread)
     {
-        pthread_mutex_lock(&bandwidth_mutex);
-        while(active_file_index != 0)
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        uint64_t counter;
+        bool tick_expired = false;
+        if ((fds[0].revents & POLLIN) && read(telemetry_event_fd, &counter, sizeof(counter)) < 0)
+        {
+            perror("read eventfd");
+        }
+        if ((fds[1].revents & POLLIN) && read(timer_fd, &counter, sizeof(counter)) == sizeof(counter))
+        {
+            tick_expired = true;
+        }
+
+        double now = monotonic_seconds();
+        bool have_samples = false;
+        for (int i = 0; i < num_streams; i++)
+        {
+            ingest_stream_samples(&stream_telemetry[i], &consumed[i], &estimators[i], &delays[i]);
+            estimator_expire(&estimators[i], now);
+            have_samples |= consumed[i] > 0;
+        }
+        if (!have_samples)
         {
-            pthread_mutex_unlock(&bandwidth_mutex);
-            usleep(100000);
             continue;
         }
-        double avg_speed_reduced = 0;
-        double avg_speed_aug = 0;
-        int iter;
-        for (iter = 0; iter < BANDWIDTH_SIZE; iter++)
+
+        double speeds[MAX_STREAMS];
+        double total_bandwidth = 0;
+        for (int i = 0; i < num_streams; i++)
+        {
+            speeds[i] = stream_speed(&estimators[i]);
+            total_bandwidth += speeds[i];
+        }
+        double congestion = (int)((1.0 - (total_bandwidth / (LINK_BANDWIDTH))) * 100);
+        double threshold = 100.0;
+        if (congestion >= 10)
+        {
+            threshold = 100.0 - (congestion - 10.0);
+            double max_progress = atomic_load(&max_progress_per_step);
+            if (threshold < max_progress)
+                threshold = max_progress + 2;
+        }
+        // A receiver whose analysis falls behind gets less refinement data,
+        // reduced steps are quicker to analyse
+        double backlog = atomic_load(&receiver_backlog);
+        if (backlog > RECEIVER_BACKLOG_START)
         {
-            // Check if the times are not 0 (Divide by Zero) and accumulate the values
-            if (bytes_sent[iter][0] == 0 && bytes_sent[iter][1] == 0)
+            double fill = (backlog - RECEIVER_BACKLOG_START) / (1.0 - RECEIVER_BACKLOG_START);
+            double limit = 100.0 - ((fill < 1.0) ? fill : 1.0) * (100.0 - RECEIVER_BACKLOG_MIN_PROGRESS);
+            threshold = (limit < threshold) ? limit : threshold;
+        }
+        atomic_store(&dynamic_progress_threshold, threshold);
+        // Reset the values for the next acting
+        int num_steps = stream_table.num_steps;
+        int min_step = num_steps;
+        for (int i = 0; i < num_streams; i++)
+        {
+            int step = atomic_load(&stream_step[i]);
+            if (step < min_step)
             {
-                break;
+                min_step = step;
             }
-            avg_speed_reduced += time_taken[iter][0] > 0 ? ((bytes_sent[iter][0] * 8) / time_taken[iter][0]) : 0;
-            avg_speed_aug += time_taken[iter][1] > 0 ? ((bytes_sent[iter][1] * 8) / time_taken[iter][1]) : 0;
         }
-        if (iter == 0)
+        if (min_step >= num_steps)
         {
-            pthread_mutex_unlock(&bandwidth_mutex);
-            usleep(250000);
             continue;
         }
-        avg_speed_aug /= iter;
-        avg_speed_reduced /= iter;
-        double total_bandwidth = avg_speed_reduced + avg_speed_aug;
-        double congestion = (int)((1.0 - (total_bandwidth / (LINK_BANDWIDTH))) * 100);
-        if (congestion < 10)
+        StepState *state = step_state_get(&step_states, min_step);
+        if (state == NULL)
         {
-            dynamic_progress_threshold = 100.0;
+            continue;
         }
-        else
+
+        // High priority streams need everything they have left, low priority
+        // streams only what remains below the progress threshold
+        double demands[MAX_STREAMS];
+        for (int i = 0; i < num_streams; i++)
         {
-            dynamic_progress_threshold = 100.0 - (congestion - 10.0);
-            if (dynamic_progress_threshold < max_progress_per_step)
-                dynamic_progress_threshold = max_progress_per_step + 2;
+            double remaining = atomic_load(&state->remaining[i]);
+            demands[i] = remaining;
+            if (stream_table.streams[i].priority == STREAM_LOW)
+            {
+                demands[i] = 0;
+                if (atomic_load(&stream_step[i]) == min_step)
+                {
+                    double step_size = atomic_load(&state->size[i]);
+                    double partial = (threshold * step_size / 100.0) - (step_size - remaining);
+                    demands[i] = partial > 0 ? partial : 0;
+                }
+            }
         }
-        // Reset the values for the next acting
-        int min_step = 0;
-        if (step_reduced < step_aug)
+        uint64_t rates[MAX_STREAMS];
+        bool have_rates = calculate_class_rates(&stream_table, demands, LINK_BANDWIDTH, congestion, rates);
+#if APP_PACING
+        if (have_rates)
         {
-            min_step = step_reduced;
+            for (int i = 0; i < num_streams; i++)
+            {
+                pacer_set_rate(&stream_pacers[i], rates[i]);
+            }
+        }
+#endif
+        if (use_netlink)
+        {
+            if (have_rates)
+            {
+                tc_netlink_change_rates(&tc, rates, now, false);
+            }
         }
         else
         {
-            min_step = step_aug;
+            write_json("../scripts/congestion.json", demands, num_streams, LINK_BANDWIDTH, congestion);
         }
-
-        double partial_aug_file_size = 0;
-        if (min_step == step_aug)
+        if (tick_expired)
         {
-            partial_aug_file_size = (dynamic_progress_threshold * aug_file_size / 100.0) - (aug_file_size - curr_aug_files_size[min_step]);
+            for (int i = 0; i < num_streams; i++)
+            {
+                printf("speed_%s: %.2f (p50 %.2f, p90 %.2f, owd %.2f ms, queue %.2f ms)%s", stream_table.streams[i].name, speeds[i],
+                       estimator_percentile(&estimators[i], 50), estimator_percentile(&estimators[i], 90),
+                       delays[i].smoothed * 1e3, (delays[i].smoothed - delays[i].base) * 1e3,
+                       i + 1 < num_streams ? ", " : "");
+            }
+            printf(", congestion: %f%%\n", congestion);
+            printf("Dynamic Progress Threshold: %.2f%%\n", threshold);
+            if (use_netlink && tc.changes > 0)
+            {
+                printf("tc rates:");
+                for (int i = 0; i < num_streams; i++)
+                {
+                    printf(" %s %llu", stream_table.streams[i].name, (unsigned long long)tc.rates[i]);
+                }
+                printf(" bit/s, decision to applied: last %.1f us, avg %.1f us, max %.1f us\n",
+                       tc.last_latency * 1e6, tc.total_latency / tc.changes * 1e6, tc.max_latency * 1e6);
+            }
         }
-        write_json("../scripts/congestion.json", curr_reduced_file_size[min_step], partial_aug_file_size, LINK_BANDWIDTH, congestion);
-        printf("speed_reduced: %.2f, speed_aug: %.2f, congestion: %f%%\n", avg_speed_reduced, avg_speed_aug, congestion);
-         printf("Dynamic Progress Threshold: %.2f%%\n", dynamic_progress_threshold);
-        pthread_mutex_unlock(&bandwidth_mutex);
-        usleep(250000);
     }
+    tc_netlink_close(&tc);
+    close(timer_fd);
     pthread_exit(NULL);
     return NULL;
 }
 
-bool open_files(char **filenames, int num_files, FILE **files, double *file_sizes, FilesType files_type)
+void release_mapped_file(MappedFile *map)
+{
+    if (atomic_fetch_sub(&map->refs, 1) == 1)
+    {
+        if (map->size > 0)
+        {
+            munmap(map->data, map->size);
+        }
+        free(map);
+    }
+}
+
+// ZeroMQ free callback, called from the I/O thread once a chunk has been sent
+void release_mapped_chunk(void *data, void *hint)
+{
+    (void)data;
+    release_mapped_file((MappedFile *)hint);
+}
+
+MappedFile *map_file(const char *filepath)
+{
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Failed to open file");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Failed to stat file");
+        close(fd);
+        return NULL;
+    }
+    MappedFile *map = malloc(sizeof(MappedFile));
+    map->size = st.st_size;
+    map->data = NULL;
+    atomic_init(&map->refs, 1);
+    if (map->size > 0)
+    {
+        map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map->data == MAP_FAILED)
+        {
+            perror("Failed to mmap file");
+            close(fd);
+            free(map);
+            return NULL;
+        }
+        madvise(map->data, map->size, MADV_SEQUENTIAL);
+        // Start reading the file in now, the stream is usually still sending
+        // the previous step
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return map;
+}
+
+bool open_files(char *const *filenames, int num_files, FileReader **readers, MappedFile **maps, double *file_sizes, int stream_index, int step)
 {
     const char *directory = "../data/";
     for (int i = 0; i < num_files; i++)
     {
         char filepath[256];
         snprintf(filepath, sizeof(filepath), "%s%s", directory, filenames[i]);
-        files[i] = fopen(filepath, "rb");
-        if (!files[i])
+#if ZERO_COPY_SEND
+        readers[i] = NULL;
+        maps[i] = map_file(filepath);
+        if (!maps[i])
         {
-            fprintf(stderr, "Failed to open file %s\n", filenames[i]);
+            fprintf(stderr, "Failed to map file %s\n", filenames[i]);
             return false;
         }
-        fseek(files[i], 0, SEEK_END);
-        file_sizes[i] = ftell(files[i]);
-        fseek(files[i], 0, SEEK_SET);
-        pthread_mutex_lock(&bandwidth_mutex);
-        if (files_type == REDUCED)
+        file_sizes[i] = maps[i]->size;
+#else
+        // The reader starts filling its buffers right away
+        maps[i] = NULL;
+        readers[i] = file_reader_open(filepath);
+        if (!readers[i])
         {
-            curr_reduced_file_size[step_reduced] += file_sizes[i];
+            fprintf(stderr, "Failed to open file %s\n", filenames[i]);
+            return false;
         }
-        else
+        file_sizes[i] = readers[i]->file_size;
+#endif
+        StepState *state = step_state_get(&step_states, step);
+        if (state == NULL)
         {
-            curr_aug_files_size[step_aug] += file_sizes[i];
+            return false;
         }
-        aug_file_size = curr_aug_files_size[step_aug];
-        pthread_mutex_unlock(&bandwidth_mutex);
+        atomic_fetch_add(&state->remaining[stream_index], (int64_t)file_sizes[i]);
+        atomic_fetch_add(&state->size[stream_index], (int64_t)file_sizes[i]);
     }
     return true;
 }
 
-void close_files(FILE **files, int num_files, FilesType files_type)
+void close_files(FileReader **readers, MappedFile **maps, int num_files)
 {
     for (int i = 0; i < num_files; i++)
     {
-        fclose(files[i]);
+        // Chunks still queued in ZeroMQ keep the buffers and mappings alive
+        if (readers[i])
+        {
+            file_reader_close(readers[i]);
+        }
+        if (maps[i])
+        {
+            release_mapped_file(maps[i]);
+        }
     }
 }
 
@@ -228,227 +625,475 @@ void close_socket(void *socket)
     zmq_close(socket);
 }
 
-void send_data_chunk(void *socket, char *message, size_t size)
+// Start a step: one message with the size and name of every file
+void send_step_begin(void *socket, int stream_index, int step, char *const *filenames, const double *sizes, int num_files)
+{
+    size_t size = num_files * sizeof(uint64_t);
+    for (int j = 0; j < num_files; j++)
+    {
+        size += strlen(filenames[j]) + 1;
+    }
+    zmq_msg_t payload;
+    zmq_msg_init_size(&payload, size);
+    char *table = zmq_msg_data(&payload);
+    char *names = table + num_files * sizeof(uint64_t);
+    for (int j = 0; j < num_files; j++)
+    {
+        uint64_t file_size = (uint64_t)sizes[j];
+        memcpy(table + j * sizeof(uint64_t), &file_size, sizeof(uint64_t));
+        size_t length = strlen(filenames[j]) + 1;
+        memcpy(names, filenames[j], length);
+        names += length;
+    }
+    FrameHeader header;
+    frame_init(&header, FRAME_STEP_BEGIN, stream_index, step);
+    header.length = num_files;
+    frame_send(socket, &header, &payload, 0);
+}
+
+// Tell the receiver a file is complete at size bytes
+void send_file_end(void *socket, int stream_index, int step, uint32_t file_id, uint64_t size)
+{
+    FrameHeader header;
+    frame_init(&header, FRAME_FILE_END, stream_index, step);
+    header.file_id = file_id;
+    header.offset = size;
+    frame_send(socket, &header, NULL, 0);
+}
+
+// Send a slice of a mapped file without copying it, the mapping is pinned until ZeroMQ releases the message
+void send_mapped_chunk(void *socket, FrameHeader *header, MappedFile *map, size_t offset, size_t size)
 {
     zmq_msg_t msg;
-    zmq_msg_init_size(&msg, size);
-    zmq_msg_init_data(&msg, message, size, NULL, NULL);
-    zmq_msg_send(&msg, socket, 0);
-    zmq_msg_close(&msg);
+    atomic_fetch_add(&map->refs, 1);
+    zmq_msg_init_data(&msg, map->data + offset, size, release_mapped_chunk, map);
+    header->offset = offset;
+    header->length = size;
+    frame_send(socket, header, &msg, 0);
 }
 
-void recv_str_data_chunk(void *socket, char **data, size_t *size)
+// ZeroMQ free callback of a read buffer, hands it back to its reader
+void release_reader_buffer(void *data, void *hint)
+{
+    (void)data;
+    file_reader_release((ReaderBuffer *)hint);
+}
+
+// Send a filled read buffer without copying it, it returns to the reader once ZeroMQ is done
+void send_reader_buffer(void *socket, FrameHeader *header, ReaderBuffer *buffer)
 {
     zmq_msg_t msg;
-    zmq_msg_init(&msg);
-    zmq_msg_recv(&msg, socket, 0);
-    *size = zmq_msg_size(&msg);
-    *data = malloc(*size);
-    memcpy(*data, zmq_msg_data(&msg), *size);
+    zmq_msg_init_data(&msg, buffer->data, buffer->length, release_reader_buffer, buffer);
+    header->offset = buffer->offset;
+    header->length = buffer->length;
+    frame_send(socket, header, &msg, 0);
+}
+
+// Account one message in the credit window
+void window_push(SendWindow *window, double bytes)
+{
+    window->inflight_bytes[window->next_seq % SEND_WINDOW] = bytes;
+    window->sent_at[window->next_seq % SEND_WINDOW] = monotonic_seconds();
+    window->next_seq++;
+}
+
+// Receive the next chunk ack, ack_sent_ns gets the receiver's stamp of it
+bool recv_chunk_ack(void *socket, ChunkAck *ack, uint64_t *ack_sent_ns, int flags)
+{
+    FrameHeader header;
+    zmq_msg_t msg;
+    while (true)
+    {
+        if (!frame_recv(socket, &header, &msg, flags))
+        {
+            zmq_msg_close(&msg);
+            return false;
+        }
+        if (header.type == FRAME_CHUNK_ACK)
+        {
+            break;
+        }
+        fprintf(stderr, "Expected a chunk ack, got a %s frame\n", frame_type_name(header.type));
+        zmq_msg_close(&msg);
+    }
+    *ack_sent_ns = header.send_ns;
+    memset(ack, 0, sizeof(ChunkAck));
+    size_t size = zmq_msg_size(&msg);
+    memcpy(ack, zmq_msg_data(&msg), size < sizeof(ChunkAck) ? size : sizeof(ChunkAck));
     zmq_msg_close(&msg);
+    if (ack->count > ACK_BATCH)
+    {
+        ack->count = ACK_BATCH;
+    }
+    return true;
+}
+
+// Hand the per-chunk timings of an ack to the congestion thread and return the credits
+void process_chunk_ack(SendWindow *window, const ChunkAck *ack, uint64_t ack_sent_ns, int thread_index)
+{
+    uint64_t first_seq = ack->acked_through - ack->count;
+    double now = monotonic_seconds();
+    clock_sync_update(window->clock, ack->echo_send_ns, ack->echo_recv_ns, ack_sent_ns, frame_clock_ns());
+    double acked_bytes = 0;
+    double rtt = 0;
+    double delay = 0;
+    for (uint32_t i = 0; i < ack->count; i++)
+    {
+        uint64_t seq = first_seq + i;
+        if (seq < window->acked)
+        {
+            continue;
+        }
+        delay = clock_sync_one_way_delay(window->clock, ack->delay[i]);
+        telemetry_ring_push(&stream_telemetry[thread_index], window->inflight_bytes[seq % SEND_WINDOW], ack->interval[i], delay, now);
+        acked_bytes += window->inflight_bytes[seq % SEND_WINDOW];
+        rtt = now - window->sent_at[seq % SEND_WINDOW];
+    }
+    if (window->tuner && acked_bytes > 0)
+    {
+        // The tuner judges the path from the delays; the progress threshold
+        // also reflects spare link capacity and the receiver's backlog
+        chunk_tuner_on_ack(window->tuner, now, acked_bytes, rtt, delay);
+    }
+    // Wake the congestion thread
+    uint64_t one = 1;
+    if (write(telemetry_event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("write eventfd");
+    }
+    if (ack->acked_through > window->acked)
+    {
+        window->acked = ack->acked_through;
+    }
+}
+
+// Consume acks until fewer than max_inflight chunks are outstanding, then
+// pick up whatever else has already arrived without blocking
+void drain_chunk_acks(void *socket, SendWindow *window, int thread_index, uint64_t max_inflight)
+{
+    ChunkAck ack;
+    uint64_t ack_sent_ns;
+    while (window->next_seq - window->acked > max_inflight)
+    {
+        if (!recv_chunk_ack(socket, &ack, &ack_sent_ns, 0))
+        {
+            fprintf(stderr, "Failed to receive chunk ack: %s\n", zmq_strerror(zmq_errno()));
+            return;
+        }
+        process_chunk_ack(window, &ack, ack_sent_ns, thread_index);
+    }
+    while (window->next_seq > window->acked && recv_chunk_ack(socket, &ack, &ack_sent_ns, ZMQ_DONTWAIT))
+    {
+        process_chunk_ack(window, &ack, ack_sent_ns, thread_index);
+    }
 }
 
-void recv_double_data_chunk(void *socket, double *double_data)
+// Wait for the receiver to confirm the step is on disk, and take its analysis backlog
+bool recv_step_ack(void *socket, int step)
 {
+    FrameHeader header;
     zmq_msg_t msg;
-    zmq_msg_init(&msg);
-    zmq_msg_recv(&msg, socket, 0);
-    *double_data = *(double *)zmq_msg_data(&msg); // Convert the data to double
+    while (frame_recv(socket, &header, &msg, 0))
+    {
+        zmq_msg_close(&msg);
+        if (header.type == FRAME_STEP_ACK && header.step == (uint32_t)step)
+        {
+            if (header.offset > 0)
+            {
+                atomic_store(&receiver_backlog, (double)header.length / (double)header.offset);
+            }
+            return true;
+        }
+    }
     zmq_msg_close(&msg);
+    return false;
+}
+
+// Append the chunk-size decisions of a step and the size it ended with
+void export_chunk_tuning(ChunkTuner *tuner, int thread_index, int step)
+{
+    FILE *file = fopen("../data/chunk_size.csv", "a");
+    if (file == NULL)
+    {
+        perror("Error opening chunk size log");
+        chunk_tuner_clear_events(tuner);
+        return;
+    }
+    const char *stream = stream_table.streams[thread_index].name;
+    for (int i = 0; i < tuner->num_events; i++)
+    {
+        ChunkTuneEvent *event = &tuner->events[i];
+        fprintf(file, "%d,%s,%zu,%s,%.6f,%.0f\n", event->step, stream, event->chunk_size,
+                chunk_tune_reason_name(event->reason), event->rtt, event->rate);
+    }
+    fprintf(file, "%d,%s,%zu,step_end,%.6f,%.0f\n", step, stream, chunk_tuner_size(tuner), tuner->srtt, tuner->last_rate);
+    fclose(file);
+    chunk_tuner_clear_events(tuner);
+}
+
+// Prepare stage of a stream: open and read ahead the files of the next steps
+// while the send stage is busy with the current one, at most PIPELINE_DEPTH ahead
+void *prepare_steps(void *arg)
+{
+    ThreadArgs *args = (ThreadArgs *)arg;
+    const StreamDescriptor *stream = args->stream;
+    for (int step = 0; step < stream_table.num_steps; step++)
+    {
+        PreparedStep *prepared = calloc(1, sizeof(PreparedStep));
+        prepared->step = step;
+        if (!open_files(stream->filenames, stream->num_files, prepared->readers, prepared->maps, prepared->sizes, args->thread_index, step))
+        {
+            fprintf(stderr, "Stream %s: failed to prepare step %d\n", stream->name, step);
+            close_files(prepared->readers, prepared->maps, stream->num_files);
+            free(prepared);
+            break;
+        }
+        step_queue_push(args->queue, prepared);
+    }
+    step_queue_close(args->queue);
+    pthread_exit(NULL);
+    return NULL;
 }
 
+// Send stage of a stream. It also drains the acks, ZeroMQ sockets cannot be
+// shared between threads.
 void *send_data(void *arg)
 {
     // Read args
     ThreadArgs *args = (ThreadArgs *)arg;
-    char **filenames = args->filenames;
-    int num_files = args->num_files;
+    const StreamDescriptor *stream = args->stream;
+    char *const *filenames = stream->filenames;
+    int num_files = stream->num_files;
     int thread_index = args->thread_index;
 
-    void *sender = connect_socket(BASE_PORT + thread_index);
-    int step = 0;
-    while (step < NUM_STEPS)
+    StepQueue queue;
+    step_queue_init(&queue);
+    args->queue = &queue;
+    pthread_t prepare_thread;
+    if (pthread_create(&prepare_thread, NULL, prepare_steps, args) != 0)
     {
-        // Send all filenames at in consecutive order
-        for (int j = 0; j < num_files; j++)
-        {
-            send_data_chunk(sender, filenames[j], strlen(filenames[j]) + 1);
-        }
-        // End of filenames
-        send_data_chunk(sender, "", 0);
+        fprintf(stderr, "Error: Failed to create prepare thread for stream %s\n", stream->name);
+        pthread_exit(NULL);
+    }
+
+    void *sender = connect_socket(stream->port);
+    PreparedStep *prepared;
+    // Chunk size follows the measured RTT and throughput, and carries over between steps
+    ChunkTuner tuner;
+    chunk_tuner_init(&tuner, SEND_WINDOW);
+    // Offset to the receiver's clock, refined by every ack
+    ClockSync clock;
+    clock_sync_init(&clock);
+    while ((prepared = step_queue_pop(&queue)) != NULL)
+    {
+        int step = prepared->step;
+        StepState *state = step_state_get(&step_states, step);
+        chunk_tuner_begin_step(&tuner, step);
+        // Files opened by the prepare stage
+        FileReader **readers = prepared->readers;
+        MappedFile **maps = prepared->maps;
+        double *total_files_size = prepared->sizes;
 
-        // Open file for reading
-        FILE *files[num_files];
+        // Announce every file with its id and size so the receiver can preallocate
+        // it, data chunks then carry the id and their offset in the file
+        send_step_begin(sender, thread_index, step, filenames, total_files_size, num_files);
+        FrameHeader chunk;
+        frame_init(&chunk, FRAME_CHUNK, thread_index, step);
         bool read_files[num_files];
-        double total_files_size[num_files];
-        open_files(filenames, num_files, files, total_files_size, thread_index ? AUG : REDUCED);
 
         // Send file data
         int file_index = 0;
         int num_sent_files = 0;
-        size_t chunk_size = 0.01f * total_files_size[0];
         double bytes_sent_per_file[num_files];
         for (int i = 0; i < num_files; i++)
         {
             bytes_sent_per_file[i] = 0;
             read_files[i] = false;
         }
-        int iter = 0;
+        SendWindow window = {.tuner = &tuner, .clock = &clock};
         while (num_sent_files < num_files)
         {
-            char *buffer = (char *)malloc(chunk_size);
-            size_t bytes_read = fread(buffer, 1, chunk_size, files[file_index]);
-            bytes_sent_per_file[file_index] += bytes_read;
-            fseek(files[file_index], bytes_sent_per_file[file_index], SEEK_SET);
-            pthread_mutex_lock(&bandwidth_mutex);
-            if (thread_index == 0)
+            size_t chunk_size = chunk_tuner_size(&tuner);
+#if ZERO_COPY_SEND
+            size_t chunk_offset = bytes_sent_per_file[file_index];
+            size_t bytes_read = 0;
+            if (chunk_offset < maps[file_index]->size)
             {
-                curr_reduced_file_size[step_reduced] -= bytes_read;
+                bytes_read = maps[file_index]->size - chunk_offset;
+                bytes_read = (bytes_read < chunk_size) ? bytes_read : chunk_size;
             }
-            else
+            bytes_sent_per_file[file_index] += bytes_read;
+#else
+            // The chunk leaves as the reader's buffers, one message each, sized to
+            // the chunk (or the pacing slice) up to READER_BUFFER_SIZE
+            size_t read_size = (APP_PACING && chunk_size > PACER_SLICE_SIZE) ? PACER_SLICE_SIZE : chunk_size;
+            file_reader_set_read_size(readers[file_index], read_size);
+            size_t bytes_read = 0;
+            ReaderBuffer *buffer;
+            while (bytes_read < chunk_size && file_reader_next(readers[file_index], &buffer))
             {
-                curr_aug_files_size[step_aug] -= bytes_read;
+                bytes_read += buffer->length;
+#if APP_PACING
+                pacer_wait(&stream_pacers[thread_index], buffer->length);
+#endif
+                window_push(&window, buffer->length);
+                chunk.file_id = file_index;
+                send_reader_buffer(sender, &chunk, buffer);
+                drain_chunk_acks(sender, &window, thread_index, SEND_WINDOW - 1);
             }
-            pthread_mutex_unlock(&bandwidth_mutex);
+            bytes_sent_per_file[file_index] += bytes_read;
+#endif
+            atomic_fetch_sub(&state->remaining[thread_index], (int64_t)bytes_read);
             // Send the file data
             if (bytes_read > 0)
             {
-                send_data_chunk(sender, buffer, bytes_read);
-                // Receive Log info
-                double log_message;
-                recv_double_data_chunk(sender, &log_message);
-
-                // calculate bandwidth based on time taken in Mbps
-                pthread_mutex_lock(&bandwidth_mutex);
-                time_taken[thread_index ? aug_index : reduced_index][thread_index] = log_message;
-                bytes_sent[thread_index ? aug_index : reduced_index][thread_index] = bytes_read;
-                if (thread_index == 0)
-                {
-                    reduced_index = (reduced_index + 1) % BANDWIDTH_SIZE;
-                }
-                else
+#if ZERO_COPY_SEND
+                MappedFile *source = maps[file_index];
+                // A paced chunk leaves as several messages so a rate change applies
+                // to the next slice; ZeroMQ only flushes multipart messages on their
+                // last frame, hence separate messages rather than frames
+                size_t slice_size = APP_PACING ? PACER_SLICE_SIZE : bytes_read;
+                for (size_t sent = 0; sent < bytes_read; sent += slice_size)
                 {
-                    aug_index = (aug_index + 1) % BANDWIDTH_SIZE;
+                    size_t slice = (bytes_read - sent < slice_size) ? bytes_read - sent : slice_size;
+#if APP_PACING
+                    pacer_wait(&stream_pacers[thread_index], slice);
+#endif
+                    window_push(&window, slice);
+                    chunk.file_id = file_index;
+                    send_mapped_chunk(sender, &chunk, source, chunk_offset + sent, slice);
+
+                    // Wait for credit only when the window is full, the acks carry the
+                    // receiver timings the congestion thread works on
+                    drain_chunk_acks(sender, &window, thread_index, SEND_WINDOW - 1);
                 }
-                pthread_mutex_unlock(&bandwidth_mutex);
+#endif
 
                 // Check if the file has been completely sent based on progress
-                if (thread_index == 1)
+                if (bytes_sent_per_file[file_index] >= total_files_size[file_index])
+                {
+                    read_files[file_index] = true;
+                }
+                else if (stream->priority == STREAM_LOW)
                 {
                     double progress = ((double)bytes_sent_per_file[file_index] / (double)total_files_size[file_index]) * 100.0f;
                     // printf("File: %s, Progress: %.2f%%\n", filenames[file_index], progress);
-                    double dynamic_progress = 0.0;
-                    pthread_mutex_lock(&bandwidth_mutex);
-                    dynamic_progress = dynamic_progress_threshold;
-                    pthread_mutex_unlock(&bandwidth_mutex);
+                    double dynamic_progress = atomic_load(&dynamic_progress_threshold);
                     if (progress >= dynamic_progress)
                     {
                         // Send the close message with 0 bytes
                         printf("File: %s, Progress: %.2f%%\n", filenames[file_index], progress);
-                        send_data_chunk(sender, "", 0);
                         read_files[file_index] = true;
-                        num_sent_files++;
                     }
-                    pthread_mutex_lock(&bandwidth_mutex);
-                    max_progress_per_step = (progress < max_progress_per_step) ? progress : max_progress_per_step;
-                    pthread_mutex_unlock(&bandwidth_mutex);
-                }
-                iter++;
-                if ((read_files[file_index]) || (iter % 1 == 0))
-                {
-                    file_index = (file_index + 1) % num_files;
-                    pthread_mutex_lock(&bandwidth_mutex);
-                    active_file_index = file_index;
-                    pthread_mutex_unlock(&bandwidth_mutex);
-                    iter = 0;
+                    double max_progress = atomic_load(&max_progress_per_step);
+                    atomic_store(&max_progress_per_step, (progress < max_progress) ? progress : max_progress);
                 }
-                free(buffer);
             }
             else
             {
-                // Send the close message with 0 bytes
-                send_data_chunk(sender, "", 0);
-                close_files(files, num_files, thread_index ? AUG : REDUCED);
-                break;
+                // Nothing left to read (the file shrank or failed)
+                read_files[file_index] = true;
+            }
+
+            if (read_files[file_index])
+            {
+                // Close the file at the bytes sent, the receiver truncates it there
+                send_file_end(sender, thread_index, step, file_index, (uint64_t)bytes_sent_per_file[file_index]);
+                num_sent_files++;
+            }
+            // Round robin over the files that still have data to send
+            for (int next = 1; next <= num_files && num_sent_files < num_files; next++)
+            {
+                int candidate = (file_index + next) % num_files;
+                if (!read_files[candidate])
+                {
+                    file_index = candidate;
+                    break;
+                }
             }
         }
+        // The receiver flushes its last partial batch on the end-of-file marker
+        drain_chunk_acks(sender, &window, thread_index, 0);
+        close_files(readers, maps, num_files);
+        free(prepared);
+        export_chunk_tuning(&tuner, thread_index, step);
 
-        // Alert message
-        // if 0 that means the port is complete and no more steps,
-        // if 1 move to the next step by incrementing step
-        bool is_port_complete = (step == NUM_STEPS - 1);
-        send_data_chunk(sender, (is_port_complete) ? "0" : "1", 2);
-        char *ack_message;
-        size_t ack_size;
-        recv_str_data_chunk(sender, &ack_message, &ack_size);
-        printf("Received ack message: %s\n", ack_message);
-        // Increment step
-        step++;
-        pthread_mutex_lock(&bandwidth_mutex);
-        if (thread_index == 0)
+        // End of the step, flagged on the last one so the receiver stops
+        FrameHeader step_end;
+        frame_init(&step_end, FRAME_STEP_END, thread_index, step);
+        if (step == stream_table.num_steps - 1)
         {
-            step_reduced = step;
+            step_end.flags = FRAME_LAST_STEP;
         }
-        else
+        frame_send(sender, &step_end, NULL, 0);
+        if (recv_step_ack(sender, step))
         {
-            step_aug = step;
+            printf("Step (%d): receiver has the %s files\n", step, stream->name);
         }
-        pthread_mutex_unlock(&bandwidth_mutex);
+        // Increment step
+        atomic_store(&stream_step[thread_index], step + 1);
     }
 
+    pthread_join(prepare_thread, NULL);
+    step_queue_destroy(&queue);
     close_socket(sender);
     pthread_exit(NULL);
     return NULL;
 }
 
-int main()
+int main(int argc, char **argv)
 {
     // start_net_layer();
     // sleep(5);
     printf("Starting Sender...\n");
+    if (!stream_table_init(&stream_table, argc > 1 ? argv[1] : STREAMS_CONFIG, BASE_PORT))
+    {
+        return EXIT_FAILURE;
+    }
+    int num_streams = stream_table.num_streams;
+    step_state_table_init(&step_states);
     context = zmq_ctx_new();
-    pthread_t reduced_thread, aug_thread, congestion_thread;
-
-    pthread_create(&congestion_thread, NULL, calculate_congestion, NULL);
-
-    // Filenames to be sent
-    char *reduced_filenames[] = {"reduced_data_xgc_16.bin"};
-    char *aug_filenames[] = {"delta_r_xgc_o.bin", "delta_z_xgc_o.bin", "delta_xgc_o.bin"};
-
-    // Create Reduced thread arguments
-    ThreadArgs reduced_args;
-    reduced_args.filenames = reduced_filenames;
-    reduced_args.num_files = 1;
-    reduced_args.thread_index = 0;
-
-    // Create a thread for sending Reduced files
-    if (pthread_create(&reduced_thread, NULL, send_data, &reduced_args) != 0)
+    for (int i = 0; i < num_streams; i++)
     {
-        fprintf(stderr, "Error: Failed to create send file thread\n");
+        telemetry_ring_init(&stream_telemetry[i]);
+        // Unlimited until the congestion thread assigns rates
+        pacer_init(&stream_pacers[i], 0, 4 * PACER_SLICE_SIZE);
+    }
+    telemetry_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (telemetry_event_fd < 0)
+    {
+        perror("eventfd");
         return EXIT_FAILURE;
     }
+    pthread_t stream_threads[MAX_STREAMS], congestion_thread;
 
-    // Create Aug thread arguments
-    ThreadArgs aug_args;
-    aug_args.filenames = aug_filenames;
-    aug_args.num_files = 3;
-    aug_args.thread_index = 1;
+    pthread_create(&congestion_thread, NULL, calculate_congestion, NULL);
 
-    // Create a thread for sending Aug files
-    if (pthread_create(&aug_thread, NULL, send_data, &aug_args) != 0)
+    // One sending thread per stream
+    ThreadArgs args[MAX_STREAMS];
+    for (int i = 0; i < num_streams; i++)
     {
-        fprintf(stderr, "Error: Failed to create send file thread\n");
-        return EXIT_FAILURE;
+        args[i].stream = &stream_table.streams[i];
+        args[i].thread_index = i;
+        if (pthread_create(&stream_threads[i], NULL, send_data, &args[i]) != 0)
+        {
+            fprintf(stderr, "Error: Failed to create send file thread for stream %s\n", stream_table.streams[i].name);
+            return EXIT_FAILURE;
+        }
     }
 
-    // Wait for the send file thread to finish
-    pthread_join(reduced_thread, NULL);
-    pthread_join(aug_thread, NULL);
+    // Wait for the send file threads to finish
+    for (int i = 0; i < num_streams; i++)
+    {
+        pthread_join(stream_threads[i], NULL);
+    }
 
     // stop_congestion_thread = true;
     pthread_join(congestion_thread, NULL);
     // Clean up ZeroMQ context
     zmq_ctx_destroy(context);
+    stream_table_free(&stream_table);
+    step_state_table_free(&step_states);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,32 @@
+#ifndef STEP_QUEUE_H
+#define STEP_QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Steps a stream may have prepared ahead of the one it is sending
+#ifndef PIPELINE_DEPTH
+#define PIPELINE_DEPTH 2
+#endif
+
+// Bounded FIFO between the prepare stage and the send stage of a stream.
+// Push blocks while the queue is full, pop blocks while it is empty and
+// returns NULL once the producer has closed it and it is drained.
+typedef struct
+{
+    void *items[PIPELINE_DEPTH];
+    int head;
+    int count;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} StepQueue;
+
+void step_queue_init(StepQueue *queue);
+void step_queue_push(StepQueue *queue, void *item);
+void *step_queue_pop(StepQueue *queue);
+void step_queue_close(StepQueue *queue);
+void step_queue_destroy(StepQueue *queue);
+
+#endif // STEP_QUEUE_H
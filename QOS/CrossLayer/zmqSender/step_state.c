@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "step_state.h"
+
+void step_state_table_init(StepStateTable *table)
+{
+    for (int i = 0; i < STEP_MAX_SEGMENTS; i++)
+    {
+        atomic_init(&table->segments[i], NULL);
+    }
+    pthread_mutex_init(&table->grow_lock, NULL);
+}
+
+// Counters of a step, allocating its segment on first use. Returns NULL for
+// steps out of range.
+StepState *step_state_get(StepStateTable *table, int step)
+{
+    if (step < 0 || step >= STEP_SEGMENT_SIZE * STEP_MAX_SEGMENTS)
+    {
+        fprintf(stderr, "Step %d out of range\n", step);
+        return NULL;
+    }
+    int index = step / STEP_SEGMENT_SIZE;
+    StepState *segment = atomic_load_explicit(&table->segments[index], memory_order_acquire);
+    if (segment == NULL)
+    {
+        pthread_mutex_lock(&table->grow_lock);
+        segment = atomic_load_explicit(&table->segments[index], memory_order_relaxed);
+        if (segment == NULL)
+        {
+            // calloc leaves every counter at zero
+            segment = calloc(STEP_SEGMENT_SIZE, sizeof(StepState));
+            if (segment == NULL)
+            {
+                perror("Failed to allocate step state");
+                pthread_mutex_unlock(&table->grow_lock);
+                return NULL;
+            }
+            atomic_store_explicit(&table->segments[index], segment, memory_order_release);
+        }
+        pthread_mutex_unlock(&table->grow_lock);
+    }
+    return &segment[step % STEP_SEGMENT_SIZE];
+}
+
+void step_state_table_free(StepStateTable *table)
+{
+    for (int i = 0; i < STEP_MAX_SEGMENTS; i++)
+    {
+        free(atomic_load(&table->segments[i]));
+        atomic_store(&table->segments[i], NULL);
+    }
+    pthread_mutex_destroy(&table->grow_lock);
+}
@@ -0,0 +1,33 @@
+#ifndef STEP_STATE_H
+#define STEP_STATE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "streams.h"
+
+// Step counters are allocated in segments of STEP_SEGMENT_SIZE steps as the
+// run advances, up to STEP_SEGMENT_SIZE * STEP_MAX_SEGMENTS steps
+#define STEP_SEGMENT_SIZE 64
+#define STEP_MAX_SEGMENTS 1024
+
+// Byte accounting of one step, per stream
+typedef struct
+{
+    _Atomic int64_t remaining[MAX_STREAMS]; // bytes not yet handed to ZeroMQ
+    _Atomic int64_t size[MAX_STREAMS];      // total bytes of the step's files
+} StepState;
+
+// Segments never move once published, so readers keep plain pointers to a
+// StepState while the writers append new steps
+typedef struct
+{
+    StepState *_Atomic segments[STEP_MAX_SEGMENTS];
+    pthread_mutex_t grow_lock;
+} StepStateTable;
+
+void step_state_table_init(StepStateTable *table);
+StepState *step_state_get(StepStateTable *table, int step);
+void step_state_table_free(StepStateTable *table);
+
+#endif // STEP_STATE_H
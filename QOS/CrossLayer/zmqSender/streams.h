@@ -0,0 +1,50 @@
+#ifndef STREAMS_H
+#define STREAMS_H
+
+#include <stdbool.h>
+
+// Shared by the sender and the receiver, keep both copies identical
+
+// One port, one HTB class (1:index+1) and one sender/receiver thread per stream
+#define MAX_STREAMS 8
+#define MAX_STREAM_FILES 16
+#define STREAM_NAME_SIZE 32
+
+// Steps sent when the table does not say
+#define DEFAULT_NUM_STEPS 1
+
+// Stream table read at startup when present, relative to the build directory
+#define STREAMS_CONFIG "../streams.json"
+
+typedef enum
+{
+    STREAM_LOW, // refinement data, cut short by the dynamic progress threshold under congestion
+    STREAM_HIGH // always delivered whole (reduced data, metadata)
+} StreamPriority;
+
+typedef struct
+{
+    char name[STREAM_NAME_SIZE];
+    char directory[STREAM_NAME_SIZE]; // receiver output directory under ../data/
+    StreamPriority priority;
+    double weight;    // scales the stream's outstanding bytes when splitting the link
+    double min_share; // bounds on the stream's fraction of the available bandwidth
+    double max_share;
+    int port;
+    int num_files;
+    char *filenames[MAX_STREAM_FILES];
+} StreamDescriptor;
+
+typedef struct
+{
+    int num_steps;
+    int num_streams;
+    StreamDescriptor streams[MAX_STREAMS];
+} StreamTable;
+
+bool stream_table_load(StreamTable *table, const char *path, int base_port);
+void stream_table_default(StreamTable *table, int base_port);
+bool stream_table_init(StreamTable *table, const char *path, int base_port);
+void stream_table_free(StreamTable *table);
+
+#endif // STREAMS_H
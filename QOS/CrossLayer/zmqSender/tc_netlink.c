@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include "tc_netlink.h"
+
+#define TC_MSG_SIZE 1024
+#define TIME_UNITS_PER_SEC 1000000.0
+#define TC_DEFAULT_MTU 1600
+#define HTB_HANDLE(minor) ((1U << 16) | (minor))
+
+typedef struct
+{
+    struct nlmsghdr header;
+    struct tcmsg tc;
+    char attrs[TC_MSG_SIZE];
+} TcRequest;
+
+static double monotonic_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Append an attribute to the request, NULL when it does not fit
+static struct rtattr *add_attr(TcRequest *req, int type, const void *data, int len)
+{
+    char *buffer = (char *)req;
+    size_t offset = NLMSG_ALIGN(req->header.nlmsg_len);
+    if (len < 0 || offset + RTA_SPACE(len) > sizeof(TcRequest))
+    {
+        fprintf(stderr, "netlink attribute %d does not fit the request\n", type);
+        return NULL;
+    }
+    struct rtattr *attr = (struct rtattr *)(buffer + offset);
+    attr->rta_type = type;
+    attr->rta_len = RTA_LENGTH(len);
+    if (len > 0)
+    {
+        memcpy(RTA_DATA(attr), data, len);
+    }
+    req->header.nlmsg_len = offset + RTA_ALIGN(attr->rta_len);
+    return attr;
+}
+
+static void end_nested_attr(TcRequest *req, struct rtattr *nest)
+{
+    if (nest != NULL)
+    {
+        nest->rta_len = (char *)req + NLMSG_ALIGN(req->header.nlmsg_len) - (char *)nest;
+    }
+}
+
+// Packet scheduler clock, same derivation as iproute2's tc_core_init and get_hz
+static void read_psched(TcNetlink *tc)
+{
+    unsigned int t2us = 1, us2t = 1, clock_res = 1000000, hz = 1000;
+    FILE *file = fopen("/proc/net/psched", "r");
+    if (file)
+    {
+        unsigned int nom, denom;
+        if (fscanf(file, "%08x%08x%08x%08x", &t2us, &us2t, &nom, &denom) == 4)
+        {
+            clock_res = nom;
+            if (nom == 1000000)
+            {
+                hz = denom;
+            }
+        }
+        fclose(file);
+    }
+    if (clock_res == 1000000000)
+    {
+        t2us = us2t;
+    }
+    tc->tick_in_usec = (double)t2us / us2t * (clock_res / TIME_UNITS_PER_SEC);
+    tc->hz = hz;
+}
+
+static uint32_t xmit_ticks(const TcNetlink *tc, uint64_t rate_bytes, uint64_t size)
+{
+    return (uint32_t)(TIME_UNITS_PER_SEC * ((double)size / (double)rate_bytes) * tc->tick_in_usec);
+}
+
+static void init_request(TcNetlink *tc, TcRequest *req, int type, int flags, uint32_t parent, uint32_t handle)
+{
+    memset(req, 0, sizeof(TcRequest));
+    req->header.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    req->header.nlmsg_type = type;
+    req->header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    req->header.nlmsg_seq = ++tc->seq;
+    req->tc.tcm_family = AF_UNSPEC;
+    req->tc.tcm_ifindex = tc->ifindex;
+    req->tc.tcm_parent = parent;
+    req->tc.tcm_handle = handle;
+}
+
+// HTB class message with rate == ceil, mirroring `tc class ... htb rate R ceil R`
+static void init_class_request(TcNetlink *tc, TcRequest *req, int flags, int class_index, uint64_t rate_bits)
+{
+    init_request(tc, req, RTM_NEWTCLASS, flags, HTB_HANDLE(0), HTB_HANDLE(class_index + 1));
+    add_attr(req, TCA_KIND, "htb", 4);
+
+    uint64_t rate_bytes = rate_bits / 8 > 0 ? rate_bits / 8 : 1;
+    struct tc_htb_opt opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.rate.rate = rate_bytes >= UINT32_MAX ? UINT32_MAX : rate_bytes;
+    opt.rate.linklayer = TC_LINKLAYER_ETHERNET;
+    opt.ceil = opt.rate;
+    opt.buffer = xmit_ticks(tc, rate_bytes, rate_bytes / tc->hz + tc->mtu);
+    opt.cbuffer = opt.buffer;
+
+    struct rtattr *options = add_attr(req, TCA_OPTIONS, NULL, 0);
+    add_attr(req, TCA_HTB_PARMS, &opt, sizeof(opt));
+    if (rate_bytes >= UINT32_MAX)
+    {
+        add_attr(req, TCA_HTB_RATE64, &rate_bytes, sizeof(rate_bytes));
+        add_attr(req, TCA_HTB_CEIL64, &rate_bytes, sizeof(rate_bytes));
+    }
+    end_nested_attr(req, options);
+}
+
+static int send_request(TcNetlink *tc, TcRequest *req)
+{
+    struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+    if (sendto(tc->fd, req, req->header.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+    {
+        perror("netlink sendto");
+        return -1;
+    }
+    return 0;
+}
+
+// Collect `pending` acks. Errors listed in `ignore_errno` count as success.
+// Returns the number of failed requests or -1 on a socket error.
+static int recv_acks(TcNetlink *tc, int pending, int ignore_errno)
+{
+    char buffer[8192];
+    int failed = 0;
+    while (pending > 0)
+    {
+        ssize_t len = recv(tc->fd, buffer, sizeof(buffer), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("netlink recv");
+            return -1;
+        }
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, (size_t)len); header = NLMSG_NEXT(header, len))
+        {
+            if (header->nlmsg_type != NLMSG_ERROR)
+            {
+                continue;
+            }
+            struct nlmsgerr *err = NLMSG_DATA(header);
+            if (err->error != 0 && -err->error != ignore_errno)
+            {
+                fprintf(stderr, "tc request %u failed: %s\n", header->nlmsg_seq, strerror(-err->error));
+                failed++;
+            }
+            pending--;
+        }
+    }
+    return failed;
+}
+
+int tc_netlink_open(TcNetlink *tc, const char *interface, int num_classes)
+{
+    memset(tc, 0, sizeof(TcNetlink));
+    tc->fd = -1;
+    if (num_classes < 1 || num_classes > TC_MAX_CLASSES)
+    {
+        fprintf(stderr, "Unsupported number of tc classes: %d\n", num_classes);
+        return -1;
+    }
+    tc->num_classes = num_classes;
+    tc->ifindex = if_nametoindex(interface);
+    if (tc->ifindex == 0)
+    {
+        fprintf(stderr, "Unknown interface %s\n", interface);
+        return -1;
+    }
+
+    tc->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (tc->fd < 0)
+    {
+        perror("netlink socket");
+        return -1;
+    }
+    struct sockaddr_nl local = {.nl_family = AF_NETLINK};
+    if (bind(tc->fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        perror("netlink bind");
+        tc_netlink_close(tc);
+        return -1;
+    }
+
+    // Burst buffer is sized from tc's default packet length
+    tc->mtu = TC_DEFAULT_MTU;
+    read_psched(tc);
+    return 0;
+}
+
+// Create the root HTB qdisc and its classes when missing (like AddClasses.sh).
+// Filters mapping ports to classes are static and still come from AddFilters.sh.
+int tc_netlink_setup(TcNetlink *tc, const uint64_t *rates)
+{
+    TcRequest req;
+    init_request(tc, &req, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, TC_H_ROOT, HTB_HANDLE(0));
+    add_attr(&req, TCA_KIND, "htb", 4);
+    struct tc_htb_glob glob = {.version = 3, .rate2quantum = 10};
+    struct rtattr *options = add_attr(&req, TCA_OPTIONS, NULL, 0);
+    add_attr(&req, TCA_HTB_INIT, &glob, sizeof(glob));
+    end_nested_attr(&req, options);
+    if (send_request(tc, &req) != 0 || recv_acks(tc, 1, EEXIST) != 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < tc->num_classes; i++)
+    {
+        init_class_request(tc, &req, NLM_F_CREATE, i, rates[i]);
+        if (send_request(tc, &req) != 0)
+        {
+            return -1;
+        }
+    }
+    if (recv_acks(tc, tc->num_classes, 0) != 0)
+    {
+        return -1;
+    }
+    memcpy(tc->rates, rates, tc->num_classes * sizeof(uint64_t));
+    return 0;
+}
+
+// Issue `tc class change` for every class whose rate moved by more than
+// TC_CHANGE_THRESHOLD (all of them when force is set). The requests are
+// pipelined on the socket and the latency from decided_at (CLOCK_MONOTONIC
+// seconds) to the last kernel ack is recorded. Returns the number of classes
+// changed or -1 on failure.
+int tc_netlink_change_rates(TcNetlink *tc, const uint64_t *rates, double decided_at, bool force)
+{
+    TcRequest req;
+    int pending = 0;
+    for (int i = 0; i < tc->num_classes; i++)
+    {
+        double old_rate = tc->rates[i];
+        double change = old_rate > 0 ? (rates[i] - old_rate) / old_rate : 1.0;
+        if (!force && change <= TC_CHANGE_THRESHOLD && change >= -TC_CHANGE_THRESHOLD)
+        {
+            continue;
+        }
+        init_class_request(tc, &req, 0, i, rates[i]);
+        if (send_request(tc, &req) != 0)
+        {
+            return -1;
+        }
+        tc->rates[i] = rates[i];
+        pending++;
+    }
+    if (pending == 0)
+    {
+        return 0;
+    }
+    if (recv_acks(tc, pending, 0) != 0)
+    {
+        return -1;
+    }
+
+    double latency = monotonic_now() - decided_at;
+    tc->changes++;
+    tc->last_latency = latency;
+    tc->total_latency += latency;
+    if (latency > tc->max_latency)
+    {
+        tc->max_latency = latency;
+    }
+    return pending;
+}
+
+void tc_netlink_close(TcNetlink *tc)
+{
+    if (tc->fd >= 0)
+    {
+        close(tc->fd);
+        tc->fd = -1;
+    }
+}
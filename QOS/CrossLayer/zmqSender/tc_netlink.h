@@ -0,0 +1,36 @@
+#ifndef TC_NETLINK_H
+#define TC_NETLINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// HTB classes 1:1 .. 1:TC_MAX_CLASSES under the root qdisc 1:
+#define TC_MAX_CLASSES 8
+// Skip a class update when its rate moved by less than this fraction
+#define TC_CHANGE_THRESHOLD 0.10
+
+// Persistent rtnetlink handle that owns the HTB classes of one interface
+typedef struct
+{
+    int fd;
+    int ifindex;
+    uint32_t seq;
+    int num_classes;
+    uint32_t mtu;
+    double tick_in_usec;
+    double hz;
+    uint64_t rates[TC_MAX_CLASSES]; // last applied rate per class, bits/s
+
+    // Decision-to-applied latency of rate changes, seconds
+    uint64_t changes;
+    double last_latency;
+    double max_latency;
+    double total_latency;
+} TcNetlink;
+
+int tc_netlink_open(TcNetlink *tc, const char *interface, int num_classes);
+int tc_netlink_setup(TcNetlink *tc, const uint64_t *rates);
+int tc_netlink_change_rates(TcNetlink *tc, const uint64_t *rates, double decided_at, bool force);
+void tc_netlink_close(TcNetlink *tc);
+
+#endif // TC_NETLINK_H
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tc_netlink.h"
+
+// Apply HTB class rates through the netlink backend and report how long the
+// kernel took to acknowledge them. Drop-in for AddClasses.sh:
+//   tcctl <interface> <rate_1 bit/s> [<rate_2 bit/s> ...]
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc - 2 > TC_MAX_CLASSES)
+    {
+        fprintf(stderr, "Usage: %s <interface> <rate_1> [<rate_2> ...]  (rates in bit/s, at most %d)\n", argv[0], TC_MAX_CLASSES);
+        return EXIT_FAILURE;
+    }
+
+    int num_classes = argc - 2;
+    uint64_t rates[TC_MAX_CLASSES];
+    for (int i = 0; i < num_classes; i++)
+    {
+        rates[i] = strtoull(argv[i + 2], NULL, 10);
+        if (rates[i] == 0)
+        {
+            fprintf(stderr, "Invalid rate: %s\n", argv[i + 2]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    TcNetlink tc;
+    if (tc_netlink_open(&tc, argv[1], num_classes) != 0 || tc_netlink_setup(&tc, rates) != 0)
+    {
+        tc_netlink_close(&tc);
+        return EXIT_FAILURE;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double decided_at = ts.tv_sec + ts.tv_nsec / 1e9;
+    if (tc_netlink_change_rates(&tc, rates, decided_at, true) < 0)
+    {
+        tc_netlink_close(&tc);
+        return EXIT_FAILURE;
+    }
+    printf("Applied %d class rates on %s in %.1f us\n", num_classes, argv[1], tc.last_latency * 1e6);
+    tc_netlink_close(&tc);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include "telemetry.h"
+
+#define TELEMETRY_RING_MASK (TELEMETRY_RING_SIZE - 1)
+
+_Static_assert((TELEMETRY_RING_SIZE & TELEMETRY_RING_MASK) == 0, "TELEMETRY_RING_SIZE must be a power of two");
+
+void telemetry_ring_init(TelemetryRing *ring)
+{
+    for (int i = 0; i < TELEMETRY_RING_SIZE; i++)
+    {
+        atomic_init(&ring->slots[i].bytes, 0.0);
+        atomic_init(&ring->slots[i].seconds, 0.0);
+        atomic_init(&ring->slots[i].delay, 0.0);
+        atomic_init(&ring->slots[i].completed_at, 0.0);
+    }
+    atomic_init(&ring->head, 0);
+}
+
+// Producer side: fill the slot, then publish it with a release store of head
+void telemetry_ring_push(TelemetryRing *ring, double bytes, double seconds, double delay, double completed_at)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TelemetrySlot *slot = &ring->slots[head & TELEMETRY_RING_MASK];
+    atomic_store_explicit(&slot->bytes, bytes, memory_order_relaxed);
+    atomic_store_explicit(&slot->seconds, seconds, memory_order_relaxed);
+    atomic_store_explicit(&slot->delay, delay, memory_order_relaxed);
+    atomic_store_explicit(&slot->completed_at, completed_at, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+uint64_t telemetry_ring_head(TelemetryRing *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+// Copy the samples published since `since` (at most the newest max_samples of
+// them) into out, oldest first. Samples the producer overwrote while they were
+// being copied are dropped. *next receives the position to pass as `since` on
+// the following call. Returns the number of samples copied.
+size_t telemetry_ring_snapshot(TelemetryRing *ring, uint64_t since, ChunkSample *out, size_t max_samples, uint64_t *next)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = since;
+    if (head - first > TELEMETRY_RING_SIZE)
+    {
+        first = head - TELEMETRY_RING_SIZE;
+    }
+    if (head - first > max_samples)
+    {
+        first = head - max_samples;
+    }
+
+    size_t count = 0;
+    for (uint64_t i = first; i < head; i++)
+    {
+        TelemetrySlot *slot = &ring->slots[i & TELEMETRY_RING_MASK];
+        out[count].bytes = atomic_load_explicit(&slot->bytes, memory_order_relaxed);
+        out[count].seconds = atomic_load_explicit(&slot->seconds, memory_order_relaxed);
+        out[count].delay = atomic_load_explicit(&slot->delay, memory_order_relaxed);
+        out[count].completed_at = atomic_load_explicit(&slot->completed_at, memory_order_relaxed);
+        count++;
+    }
+
+    // The producer may be writing slot head_after right now, so anything within
+    // one lap of it, head_after - TELEMETRY_RING_SIZE included, may be torn
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t head_after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t skip = 0;
+    if (head_after + 1 - first > TELEMETRY_RING_SIZE)
+    {
+        skip = head_after + 1 - first - TELEMETRY_RING_SIZE;
+        if (skip > count)
+        {
+            skip = count;
+        }
+        for (size_t i = skip; i < count; i++)
+        {
+            out[i - skip] = out[i];
+        }
+    }
+
+    if (next)
+    {
+        *next = head;
+    }
+    return count - skip;
+}
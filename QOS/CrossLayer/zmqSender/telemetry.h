@@ -0,0 +1,41 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of samples kept per stream, must be a power of two
+#define TELEMETRY_RING_SIZE 128
+
+// Transfer sample for one acknowledged chunk
+typedef struct
+{
+    double bytes;
+    double seconds;      // delivery interval measured by the receiver
+    double delay;        // one-way delay, corrected for the clock offset
+    double completed_at; // CLOCK_MONOTONIC seconds when the ack arrived
+} ChunkSample;
+
+typedef struct
+{
+    _Atomic double bytes;
+    _Atomic double seconds;
+    _Atomic double delay;
+    _Atomic double completed_at;
+} TelemetrySlot;
+
+// Single-producer ring of chunk samples. The sender thread of a stream is the
+// only writer, any number of readers take snapshots without locking.
+typedef struct
+{
+    TelemetrySlot slots[TELEMETRY_RING_SIZE];
+    _Atomic uint64_t head; // total number of samples ever published
+} TelemetryRing;
+
+void telemetry_ring_init(TelemetryRing *ring);
+void telemetry_ring_push(TelemetryRing *ring, double bytes, double seconds, double delay, double completed_at);
+uint64_t telemetry_ring_head(TelemetryRing *ring);
+size_t telemetry_ring_snapshot(TelemetryRing *ring, uint64_t since, ChunkSample *out, size_t max_samples, uint64_t *next);
+
+#endif // TELEMETRY_H
@@ -10,65 +10,14 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <pthread.h>
+#include "chunk_writer.h"
+#include "dir_cache.h"
 
 #define BASE_PORT 5555
 #define DIRECTORY "../data/"
 
 void *context;
 
-// Function to create directories recursively
-int create_directories(const char *path)
-{
-    char temp[256];
-    char *p = NULL;
-
-    // Copy the path to a temporary buffer
-    snprintf(temp, sizeof(temp), "%s", path);
-
-    // Iterate through each component of the path
-    for (p = temp + 1; *p; p++)
-    {
-        if (*p == '/')
-        {
-            *p = '\0'; // Temporarily terminate the string
-            if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
-            {
-                perror("mkdir");
-                return -1; // Directory creation failed
-            }
-            *p = '/'; // Restore the slash
-        }
-    }
-
-    // Create the final directory
-    if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
-    {
-        perror("mkdir");
-        return -1;
-    }
-
-    return 0; // Success
-}
-
-char *construct_filepath(const char *filename, int step)
-{
-    char *filepath = (char *)malloc(256 * sizeof(char));
-    if (filepath == NULL)
-    {
-        perror("Failed to allocate memory");
-        return NULL;
-    }
-    char new_directory[256];
-    snprintf(new_directory, sizeof(new_directory), "%s/%d/", DIRECTORY, step);
-    if (create_directories(new_directory) != 0)
-    {
-        free(filepath);
-        return NULL;
-    }
-    sprintf(filepath, "%s%s", new_directory, filename);
-    return filepath;
-}
-
 void run_blob_detection_scripts(int step)
 {
     int status;
@@ -126,20 +75,17 @@ void log_time_taken(struct timeval start, struct timeval end, int thread_index)
     }
 }
 
-void write_data_to_file(FILE *file, char *data, size_t size)
-{
-    char *buffer = malloc(size);
-    memcpy(buffer, data, size);
-    fwrite(buffer, 1, size, file);
-    free(buffer);
-}
-
 void *recv_data(void *arg)
 {
     int thread_index = *(int *)arg;
     free(arg);
     void *receiver;
     connect_socket(&receiver, thread_index);
+    DirCache directories;
+    if (!dir_cache_init(&directories, DIRECTORY))
+    {
+        exit(EXIT_FAILURE);
+    }
 
     int step = 0;
     bool is_port_complete = false;
@@ -155,37 +101,38 @@ void *recv_data(void *arg)
         {
             filename[filename_len - 1] = '\0';
             printf("Received filename: %s\n", filename);
-            char *filepath = construct_filepath(filename, step);
+            // Files go to ../data/<step>/, the directory is created once
+            int step_dir = dir_cache_get(&directories, "", step);
             
-            if (filepath)
+            if (step_dir >= 0)
             {
-                FILE *file = fopen(filepath, "ab");
+                ChunkWriter writer;
+                bool opened = chunk_writer_open(&writer, step_dir, filename);
                 gettimeofday(&start, NULL);
-                if (file)
+                if (opened)
                 {
                     // Receive file chunks
                     bool is_file_complete = false;
                     while (!is_file_complete)
                     {
-                        char *data;
-                        size_t chunk_size;
-                        recv_data_chunk(receiver, &data, &chunk_size);
+                        zmq_msg_t msg;
+                        zmq_msg_init(&msg);
+                        zmq_msg_recv(&msg, receiver, 0);
 
-                        if (chunk_size == 0)
+                        if (zmq_msg_size(&msg) == 0)
                         {
                             is_file_complete = true;
                             gettimeofday(&end, NULL);
-                            free(data);
+                            zmq_msg_close(&msg);
                         }
                         else
                         {
-                            write_data_to_file(file, data, chunk_size);
-                            free(data);
+                            // The writer keeps the message until its batch is on disk
+                            chunk_writer_add(&writer, &msg);
                         }
                     }
-                    fclose(file);
+                    chunk_writer_close(&writer);
                 }
-                free(filepath);
             }
             free(filename);
         }
@@ -217,6 +164,7 @@ void *recv_data(void *arg)
         }
     }
 
+    dir_cache_close(&directories);
     zmq_close(receiver);
     pthread_exit(NULL);
     return NULL;
@@ -10,6 +10,9 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <pthread.h>
+#include "chunk_writer.h"
+#include "dir_cache.h"
+#include "event_log.h"
 
 #define BASE_PORT 5555
 #define DIRECTORY "../data/"
@@ -18,59 +21,6 @@ void *context;
 int index_red = 0, index_aug = 0;
 double time_taken_red[10000] = {0}, time_taken_aug[10000] = {0};
 
-// Function to create directories recursively
-int create_directories(const char *path)
-{
-    char temp[256];
-    char *p = NULL;
-
-    // Copy the path to a temporary buffer
-    snprintf(temp, sizeof(temp), "%s", path);
-
-    // Iterate through each component of the path
-    for (p = temp + 1; *p; p++)
-    {
-        if (*p == '/')
-        {
-            *p = '\0'; // Temporarily terminate the string
-            if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
-            {
-                perror("mkdir");
-                return -1; // Directory creation failed
-            }
-            *p = '/'; // Restore the slash
-        }
-    }
-
-    // Create the final directory
-    if (mkdir(temp, S_IRWXU) != 0 && errno != EEXIST)
-    {
-        perror("mkdir");
-        return -1;
-    }
-
-    return 0; // Success
-}
-
-char *construct_filepath(const char *filename, int step)
-{
-    char *filepath = (char *)malloc(256 * sizeof(char));
-    if (filepath == NULL)
-    {
-        perror("Failed to allocate memory");
-        return NULL;
-    }
-    char new_directory[256];
-    snprintf(new_directory, sizeof(new_directory), "%s/%d/", DIRECTORY, step);
-    if (create_directories(new_directory) != 0)
-    {
-        free(filepath);
-        return NULL;
-    }
-    sprintf(filepath, "%s%s", new_directory, filename);
-    return filepath;
-}
-
 void run_blob_detection_scripts(int step)
 {
     int status;
@@ -106,11 +56,72 @@ void send_data_chunk(void *socket, char *message, size_t size)
 {
     zmq_msg_t msg;
     zmq_msg_init_size(&msg, size);
-    zmq_msg_init_data(&msg, message, size, NULL, NULL);
+    memcpy(zmq_msg_data(&msg), message, size);
     zmq_msg_send(&msg, socket, 0);
     zmq_msg_close(&msg);
 }
 
+double elapsed_between(struct timeval start, struct timeval end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+// Timing samples of one file: bytes received and the time they took
+typedef struct
+{
+    size_t *bytes;
+    double *seconds;
+    int count;
+    int capacity;
+} TimingSamples;
+
+void add_timing_sample(TimingSamples *samples, size_t bytes, double seconds)
+{
+    if (samples->count == samples->capacity)
+    {
+        int capacity = samples->capacity > 0 ? samples->capacity * 2 : 64;
+        size_t *new_bytes = realloc(samples->bytes, capacity * sizeof(size_t));
+        if (new_bytes != NULL)
+        {
+            samples->bytes = new_bytes;
+        }
+        double *new_seconds = realloc(samples->seconds, capacity * sizeof(double));
+        if (new_seconds != NULL)
+        {
+            samples->seconds = new_seconds;
+        }
+        if (new_bytes == NULL || new_seconds == NULL)
+        {
+            perror("Failed to allocate memory for timing samples");
+            return;
+        }
+        samples->capacity = capacity;
+    }
+    samples->bytes[samples->count] = bytes;
+    samples->seconds[samples->count] = seconds;
+    samples->count++;
+}
+
+// Reply "<seconds for the file> <bytes>:<seconds> ...", the total first so
+// that a plain atof still reads it
+void send_timings(void *socket, double file_seconds, const TimingSamples *samples)
+{
+    size_t size = 32 + (size_t)samples->count * 48;
+    char *reply = malloc(size);
+    if (reply == NULL)
+    {
+        perror("Failed to allocate memory for the timings");
+        return;
+    }
+    size_t length = snprintf(reply, size, "%f", file_seconds);
+    for (int i = 0; i < samples->count && length < size; i++)
+    {
+        length += snprintf(reply + length, size - length, " %zu:%f", samples->bytes[i], samples->seconds[i]);
+    }
+    send_data_chunk(socket, reply, strlen(reply) + 1);
+    free(reply);
+}
+
 void log_time_taken(struct timeval start, struct timeval end, int thread_index, bool next_step)
 {
     double time_taken = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
@@ -127,32 +138,26 @@ void log_time_taken(struct timeval start, struct timeval end, int thread_index,
         time_taken_aug[index_aug] += time_taken;
         if (next_step)
         {
-            FILE *log_file = fopen("../data/log.txt", "a");
             double time_taken_per_step = time_taken_aug[index_aug];
             if (time_taken_red[index_aug] > time_taken_aug[index_aug])
                 time_taken_per_step = time_taken_red[index_aug];
-            fprintf(log_file, "%f\n", time_taken_per_step);
-            fclose(log_file);
+            event_log(EVENT_STEP_TIME, thread_index, index_aug, time_taken_per_step, 0);
             index_aug++;
         }
     }
 }
 
-void write_data_to_file(FILE *file, char *data, size_t size)
-{
-    // fork process
-    char *buffer = malloc(size);
-    memcpy(buffer, data, size);
-    fwrite(buffer, 1, size, file);
-    free(buffer);
-}
-
 void *recv_data(void *arg)
 {
     int thread_index = *(int *)arg;
     free(arg);
     void *receiver;
     connect_socket(&receiver, thread_index);
+    DirCache directories;
+    if (!dir_cache_init(&directories, DIRECTORY))
+    {
+        exit(EXIT_FAILURE);
+    }
 
     int step = 0;
     bool is_port_complete = false;
@@ -167,36 +172,78 @@ void *recv_data(void *arg)
         {
             gettimeofday(&start, NULL);
             filename[filename_len - 1] = '\0';
+            // The sender's chunk size comes next, the timing samples close on
+            // it; with 0 the whole file is a single sample
+            char *chunk_size_text;
+            size_t chunk_size_len;
+            recv_data_chunk(receiver, &chunk_size_text, &chunk_size_len);
+            size_t sample_limit = 0;
+            if (chunk_size_len > 0)
+            {
+                chunk_size_text[chunk_size_len - 1] = '\0';
+                sample_limit = strtoull(chunk_size_text, NULL, 10);
+            }
+            free(chunk_size_text);
             printf("Received filename: %s\n", filename);
-            char *filepath = construct_filepath(filename, step);
+            // Files go to ../data/<step>/, the directory is created once
+            int step_dir = dir_cache_get(&directories, "", step);
 
-            if (filepath)
+            if (step_dir >= 0)
             {
-                FILE *file = fopen(filepath, "ab");
-                if (file)
+                ChunkWriter writer;
+                if (chunk_writer_open(&writer, step_dir, filename))
                 {
-                    // Receive file chunks
+                    // Receive file chunks until the empty end-of-file message,
+                    // a paced sender splits the data into several messages
                     bool is_file_complete = false;
-                    char *data;
+                    zmq_msg_t msg;
                     size_t chunk_size;
-                    
-                    // monitor data chunk time
+                    size_t file_size = 0;
+
+                    // monitor data chunk time, a sample closes every sample_limit bytes
                     gettimeofday(&chunk_time_start, NULL);
-                    recv_data_chunk(receiver, &data, &chunk_size);
-                    gettimeofday(&chunk_time_end, NULL);
-                    double chunk_time_taken = (chunk_time_end.tv_sec - chunk_time_start.tv_sec) + (chunk_time_end.tv_usec - chunk_time_start.tv_usec) / 1e6;
-                    printf("step (%d): Received chunk of size %ld, time taken: %f\n", step, chunk_size, chunk_time_taken);
+                    chunk_time_end = chunk_time_start;
+                    struct timeval sample_start = chunk_time_start;
+                    size_t sample_bytes = 0;
+                    TimingSamples samples = {0};
+                    while (!is_file_complete)
+                    {
+                        zmq_msg_init(&msg);
+                        zmq_msg_recv(&msg, receiver, 0);
+                        chunk_size = zmq_msg_size(&msg);
+                        if (chunk_size == 0)
+                        {
+                            is_file_complete = true;
+                            zmq_msg_close(&msg);
+                        }
+                        else
+                        {
+                            gettimeofday(&chunk_time_end, NULL);
+                            // The writer keeps the message until its batch is on disk
+                            chunk_writer_add(&writer, &msg);
+                            file_size += chunk_size;
+                            sample_bytes += chunk_size;
+                            if (sample_limit > 0 && sample_bytes >= sample_limit)
+                            {
+                                add_timing_sample(&samples, sample_bytes, elapsed_between(sample_start, chunk_time_end));
+                                sample_start = chunk_time_end;
+                                sample_bytes = 0;
+                            }
+                        }
+                    }
+                    if (sample_bytes > 0)
+                    {
+                        add_timing_sample(&samples, sample_bytes, elapsed_between(sample_start, chunk_time_end));
+                    }
+                    double chunk_time_taken = elapsed_between(chunk_time_start, chunk_time_end);
+                    printf("step (%d): Received chunk of size %ld, time taken: %f\n", step, file_size, chunk_time_taken);
 
-                    // send time taken
-                    char time_str[32];
-                    snprintf(time_str, sizeof(time_str), "%f", chunk_time_taken);
-                    send_data_chunk(receiver, time_str, strlen(time_str) + 1);
-                    write_data_to_file(file, data, chunk_size);
-                    // Free the received data
-                    free(data);
-                    fclose(file);
+                    // send time taken, with the per-chunk samples
+                    send_timings(receiver, chunk_time_taken, &samples);
+                    free(samples.bytes);
+                    free(samples.seconds);
+                    chunk_writer_close(&writer);
                 }
-                free(filepath);
             }
             free(filename);
         }
@@ -239,6 +286,7 @@ void *recv_data(void *arg)
         }
     }
 
+    dir_cache_close(&directories);
     zmq_close(receiver);
     pthread_exit(NULL);
     return NULL;
@@ -247,6 +295,8 @@ void *recv_data(void *arg)
 int main()
 {
     printf("Starting Receiver...\n");
+    // Timings go to a binary log, common/scripts/event_log_to_csv.py converts it
+    event_log_open(DIRECTORY "events.bin");
     context = zmq_ctx_new();
     pthread_t partial_data1, partial_data2;
     int *thread_index1 = malloc(sizeof(int));
@@ -269,6 +319,7 @@ int main()
         fprintf(log_file, "%f\n", time_taken_per_step);
     }
     fclose(log_file);
+    event_log_close();
 
     printf("All threads completed.\n");
     zmq_ctx_destroy(&context);
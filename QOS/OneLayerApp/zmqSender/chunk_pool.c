@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chunk_pool.h"
+
+ChunkPool *chunk_pool_create(size_t buffer_size)
+{
+    ChunkPool *pool = calloc(1, sizeof(ChunkPool));
+    if (pool == NULL)
+    {
+        perror("Failed to allocate the chunk pool");
+        return NULL;
+    }
+    pool->memory = malloc((size_t)CHUNK_POOL_BUFFERS * buffer_size);
+    if (pool->memory == NULL)
+    {
+        perror("Failed to allocate the chunk pool");
+        free(pool);
+        return NULL;
+    }
+    pool->buffer_size = buffer_size;
+    for (int i = 0; i < CHUNK_POOL_BUFFERS; i++)
+    {
+        pool->buffers[i].pool = pool;
+        pool->buffers[i].data = pool->memory + (size_t)i * buffer_size;
+        atomic_init(&pool->buffers[i].refs, 0);
+        pool->free_buffers[i] = &pool->buffers[i];
+    }
+    pool->free_count = CHUNK_POOL_BUFFERS;
+    atomic_init(&pool->refs, 1);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->returned, NULL);
+    return pool;
+}
+
+static void chunk_pool_put(ChunkPool *pool)
+{
+    if (atomic_fetch_sub(&pool->refs, 1) > 1)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->returned);
+    free(pool->memory);
+    free(pool);
+}
+
+// Take a buffer, waiting until ZeroMQ gave one back when all are in flight.
+// The caller holds one reference.
+PoolBuffer *chunk_pool_acquire(ChunkPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->free_count == 0)
+    {
+        pthread_cond_wait(&pool->returned, &pool->lock);
+    }
+    PoolBuffer *buffer = pool->free_buffers[--pool->free_count];
+    pthread_mutex_unlock(&pool->lock);
+    atomic_store(&buffer->refs, 1);
+    atomic_fetch_add(&pool->refs, 1);
+    return buffer;
+}
+
+// One more holder, e.g. a message sent from the buffer
+void chunk_pool_retain(PoolBuffer *buffer)
+{
+    atomic_fetch_add(&buffer->refs, 1);
+}
+
+// Any thread. The last holder returns the buffer to its pool.
+void chunk_pool_release(PoolBuffer *buffer)
+{
+    if (atomic_fetch_sub(&buffer->refs, 1) > 1)
+    {
+        return;
+    }
+    ChunkPool *pool = buffer->pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->free_buffers[pool->free_count++] = buffer;
+    pthread_cond_signal(&pool->returned);
+    pthread_mutex_unlock(&pool->lock);
+    chunk_pool_put(pool);
+}
+
+// The owner is done, the pool is freed once the last buffer is back
+void chunk_pool_close(ChunkPool *pool)
+{
+    if (pool != NULL)
+    {
+        chunk_pool_put(pool);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Buffers a sending thread reads file chunks into. The data is sent from
+// them without a copy, so at most this many chunks are held at once.
+#ifndef CHUNK_POOL_BUFFERS
+#define CHUNK_POOL_BUFFERS 4
+#endif
+
+typedef struct ChunkPool ChunkPool;
+
+typedef struct
+{
+    ChunkPool *pool;
+    char *data;
+    atomic_int refs; // the sending thread's and one per message in flight
+} PoolBuffer;
+
+// Fixed set of equally sized buffers reused for every file of every step.
+// Buffers may be released from any thread (a ZeroMQ free callback); the pool
+// stays allocated until the owner closed it and every buffer is back.
+struct ChunkPool
+{
+    size_t buffer_size;
+    char *memory;
+    PoolBuffer buffers[CHUNK_POOL_BUFFERS];
+    PoolBuffer *free_buffers[CHUNK_POOL_BUFFERS];
+    int free_count;
+    atomic_int refs; // the owner's and one per buffer handed out
+    pthread_mutex_t lock;
+    pthread_cond_t returned;
+};
+
+ChunkPool *chunk_pool_create(size_t buffer_size);
+PoolBuffer *chunk_pool_acquire(ChunkPool *pool);
+void chunk_pool_retain(PoolBuffer *buffer);
+void chunk_pool_release(PoolBuffer *buffer);
+void chunk_pool_close(ChunkPool *pool);
+
+#endif // CHUNK_POOL_H
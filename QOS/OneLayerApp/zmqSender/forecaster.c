@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "forecaster.h"
+
+#define FORECAST_BINS (FORECAST_WINDOW / 2 + 1)
+
+// The length of the newest step is estimated from the spacing of the others
+#if FORECAST_MIN_SAMPLES < 2
+#error "FORECAST_MIN_SAMPLES must be at least 2"
+#endif
+
+bool forecaster_init(Forecaster *forecaster)
+{
+    memset(forecaster, 0, sizeof(Forecaster));
+    forecaster->input = fftw_malloc(sizeof(double) * FORECAST_WINDOW);
+    forecaster->spectrum = fftw_malloc(sizeof(fftw_complex) * FORECAST_BINS);
+    forecaster->output = fftw_malloc(sizeof(double) * FORECAST_WINDOW);
+    if (forecaster->input == NULL || forecaster->spectrum == NULL || forecaster->output == NULL)
+    {
+        fprintf(stderr, "Failed to allocate the forecaster buffers\n");
+        fftw_free(forecaster->input);
+        fftw_free(forecaster->spectrum);
+        fftw_free(forecaster->output);
+        return false;
+    }
+    pthread_mutex_init(&forecaster->lock, NULL);
+    pthread_cond_init(&forecaster->sample_added, NULL);
+    atomic_init(&forecaster->sequence, 0);
+    atomic_init(&forecaster->published_first_step, 0);
+    atomic_init(&forecaster->published_count, 0);
+    atomic_init(&forecaster->published_mean, 0.0);
+    atomic_init(&forecaster->published_std, 0.0);
+    for (int i = 0; i < FORECAST_WINDOW; i++)
+    {
+        atomic_init(&forecaster->published_rates[i], 0.0);
+    }
+    for (int i = 0; i <= FORECAST_WINDOW; i++)
+    {
+        atomic_init(&forecaster->published_times[i], 0.0);
+        atomic_init(&forecaster->published_capacity[i], 0.0);
+    }
+    return true;
+}
+
+// Sending thread: the measured rate of a step that started start_seconds
+// after the program. Steps are expected in order, a gap restarts the history.
+void forecaster_add_sample(Forecaster *forecaster, int step, double start_seconds, double rate_mbps)
+{
+    pthread_mutex_lock(&forecaster->lock);
+    if (forecaster->count > 0 && step != forecaster->next_step)
+    {
+        forecaster->count = 0;
+    }
+    forecaster->history[step % FORECAST_WINDOW] = rate_mbps;
+    forecaster->history_times[step % FORECAST_WINDOW] = start_seconds;
+    forecaster->next_step = step + 1;
+    if (forecaster->count < FORECAST_WINDOW)
+    {
+        forecaster->count++;
+    }
+    forecaster->added++;
+    pthread_cond_signal(&forecaster->sample_added);
+    pthread_mutex_unlock(&forecaster->lock);
+}
+
+// Forecasting thread: wait for samples the last forecast did not cover.
+// Returns false once the forecaster is closed and every sample was covered.
+bool forecaster_wait(Forecaster *forecaster)
+{
+    pthread_mutex_lock(&forecaster->lock);
+    while (forecaster->added == forecaster->filtered && !forecaster->closed)
+    {
+        pthread_cond_wait(&forecaster->sample_added, &forecaster->lock);
+    }
+    bool pending = forecaster->added != forecaster->filtered;
+    pthread_mutex_unlock(&forecaster->lock);
+    return pending;
+}
+
+static void publish(Forecaster *forecaster, int first_step, int count, const double *times, double mean, double std)
+{
+    // Running totals of the forecast over time, so any interval is two lookups
+    double capacity[FORECAST_WINDOW + 1];
+    capacity[0] = 0;
+    for (int i = 0; i < count; i++)
+    {
+        capacity[i + 1] = capacity[i] + forecaster->output[i] * (times[i + 1] - times[i]);
+    }
+
+    unsigned sequence = atomic_load_explicit(&forecaster->sequence, memory_order_relaxed);
+    atomic_store_explicit(&forecaster->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&forecaster->published_first_step, first_step, memory_order_relaxed);
+    atomic_store_explicit(&forecaster->published_count, count, memory_order_relaxed);
+    atomic_store_explicit(&forecaster->published_mean, mean, memory_order_relaxed);
+    atomic_store_explicit(&forecaster->published_std, std, memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        atomic_store_explicit(&forecaster->published_rates[i], forecaster->output[i], memory_order_relaxed);
+    }
+    for (int i = 0; i <= count; i++)
+    {
+        atomic_store_explicit(&forecaster->published_times[i], times[i], memory_order_relaxed);
+        atomic_store_explicit(&forecaster->published_capacity[i], capacity[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&forecaster->sequence, sequence + 2, memory_order_release);
+}
+
+// Forecasting thread: filter the current history as fft.py does and publish
+// the result. Returns false while there are too few samples for a forecast.
+bool forecaster_update(Forecaster *forecaster)
+{
+    pthread_mutex_lock(&forecaster->lock);
+    int count = forecaster->count;
+    if (count < FORECAST_MIN_SAMPLES)
+    {
+        forecaster->filtered = forecaster->added;
+    }
+    pthread_mutex_unlock(&forecaster->lock);
+    if (count < FORECAST_MIN_SAMPLES)
+    {
+        return false;
+    }
+
+    // Planning may overwrite the buffers, so plan before they are filled.
+    // Only this thread plans, the FFTW planner is not thread safe.
+    if (forecaster->forward[count] == NULL)
+    {
+        forecaster->forward[count] = fftw_plan_dft_r2c_1d(count, forecaster->input, forecaster->spectrum, FFTW_MEASURE);
+        forecaster->backward[count] = fftw_plan_dft_c2r_1d(count, forecaster->spectrum, forecaster->output, FFTW_MEASURE);
+        if (forecaster->forward[count] == NULL || forecaster->backward[count] == NULL)
+        {
+            fprintf(stderr, "Failed to plan a %d point FFT\n", count);
+            return false;
+        }
+    }
+
+    // The newest count samples, oldest first. Samples added while planning
+    // are covered too; a restarted history is left for its next sample.
+    pthread_mutex_lock(&forecaster->lock);
+    if (forecaster->count < count)
+    {
+        pthread_mutex_unlock(&forecaster->lock);
+        return false;
+    }
+    int first_step = forecaster->next_step - count;
+    double times[FORECAST_WINDOW + 1];
+    for (int i = 0; i < count; i++)
+    {
+        double rate = forecaster->history[(first_step + i) % FORECAST_WINDOW];
+        forecaster->input[i] = (rate == 0) ? FORECAST_ZERO_RATE : rate;
+        times[i] = forecaster->history_times[(first_step + i) % FORECAST_WINDOW];
+    }
+    forecaster->filtered = forecaster->added;
+    pthread_mutex_unlock(&forecaster->lock);
+    // The newest step has not ended yet, give it the average step length
+    times[count] = times[count - 1] + (times[count - 1] - times[0]) / (count - 1);
+
+    fftw_execute(forecaster->forward[count]);
+
+    // The real transform keeps half the spectrum, every bin but DC (and
+    // Nyquist) stands for itself and its mirror in fft.py's statistics
+    int bins = count / 2 + 1;
+    double magnitudes[FORECAST_BINS];
+    double sum = 0;
+    for (int k = 0; k < bins; k++)
+    {
+        magnitudes[k] = hypot(forecaster->spectrum[k][0], forecaster->spectrum[k][1]);
+        sum += (k == 0 || 2 * k == count) ? magnitudes[k] : 2 * magnitudes[k];
+    }
+    double mean = sum / count;
+    double variance = 0;
+    for (int k = 0; k < bins; k++)
+    {
+        double deviation = magnitudes[k] - mean;
+        variance += ((k == 0 || 2 * k == count) ? 1 : 2) * deviation * deviation;
+    }
+    double std = sqrt(variance / count);
+    double threshold = mean + FORECAST_STD_FACTOR * std;
+    for (int k = 0; k < bins; k++)
+    {
+        if (magnitudes[k] < threshold)
+        {
+            forecaster->spectrum[k][0] = 0;
+            forecaster->spectrum[k][1] = 0;
+        }
+    }
+
+    // FFTW's inverse is unnormalized, negative rates are clipped as in fft.py
+    fftw_execute(forecaster->backward[count]);
+    for (int i = 0; i < count; i++)
+    {
+        double rate = forecaster->output[i] / count;
+        forecaster->output[i] = rate > 0 ? rate : 0;
+    }
+    publish(forecaster, first_step, count, times, mean, std);
+    return true;
+}
+
+// Any thread: copy the last published forecast. Returns false when there is none yet.
+bool forecaster_read(Forecaster *forecaster, Forecast *forecast)
+{
+    unsigned before, after;
+    do
+    {
+        before = atomic_load_explicit(&forecaster->sequence, memory_order_acquire);
+        forecast->first_step = atomic_load_explicit(&forecaster->published_first_step, memory_order_relaxed);
+        forecast->count = atomic_load_explicit(&forecaster->published_count, memory_order_relaxed);
+        forecast->mean_magnitude = atomic_load_explicit(&forecaster->published_mean, memory_order_relaxed);
+        forecast->std_magnitude = atomic_load_explicit(&forecaster->published_std, memory_order_relaxed);
+        if (forecast->count > FORECAST_WINDOW || forecast->count < 0)
+        {
+            forecast->count = 0;
+        }
+        for (int i = 0; i < forecast->count; i++)
+        {
+            forecast->rates[i] = atomic_load_explicit(&forecaster->published_rates[i], memory_order_relaxed);
+        }
+        for (int i = 0; i <= forecast->count; i++)
+        {
+            forecast->times[i] = atomic_load_explicit(&forecaster->published_times[i], memory_order_relaxed);
+            forecast->capacity[i] = atomic_load_explicit(&forecaster->published_capacity[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&forecaster->sequence, memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return forecast->count > 0;
+}
+
+// The forecast rate of a step: the filtered history read with period count
+double forecast_rate(const Forecast *forecast, int step)
+{
+    if (forecast->count == 0)
+    {
+        return 0;
+    }
+    int index = (step - forecast->first_step) % forecast->count;
+    return forecast->rates[index < 0 ? index + forecast->count : index];
+}
+
+// Mbits the forecast carries from times[0] to time, repeating the series
+// past its end. The step is found by binary search over the step times.
+static double cumulative_capacity(const Forecast *forecast, double time)
+{
+    double period = forecast->times[forecast->count] - forecast->times[0];
+    double offset = time - forecast->times[0];
+    double cycles = floor(offset / period);
+    double position = forecast->times[0] + (offset - cycles * period);
+    int low = 0;
+    int high = forecast->count - 1;
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (forecast->times[middle] <= position)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return cycles * forecast->capacity[forecast->count] + forecast->capacity[low] +
+           forecast->rates[low] * (position - forecast->times[low]);
+}
+
+// Mbits the forecast carries between two times (seconds since the program started)
+double forecast_capacity(const Forecast *forecast, double from, double to)
+{
+    if (forecast->count == 0 || to <= from || forecast->times[forecast->count] <= forecast->times[0])
+    {
+        return 0;
+    }
+    return cumulative_capacity(forecast, to) - cumulative_capacity(forecast, from);
+}
+
+// No more samples, forecaster_wait returns false once the pending ones are covered
+void forecaster_close(Forecaster *forecaster)
+{
+    pthread_mutex_lock(&forecaster->lock);
+    forecaster->closed = true;
+    pthread_cond_broadcast(&forecaster->sample_added);
+    pthread_mutex_unlock(&forecaster->lock);
+}
+
+void forecaster_destroy(Forecaster *forecaster)
+{
+    for (int i = 0; i <= FORECAST_WINDOW; i++)
+    {
+        if (forecaster->forward[i] != NULL)
+        {
+            fftw_destroy_plan(forecaster->forward[i]);
+        }
+        if (forecaster->backward[i] != NULL)
+        {
+            fftw_destroy_plan(forecaster->backward[i]);
+        }
+    }
+    fftw_free(forecaster->input);
+    fftw_free(forecaster->spectrum);
+    fftw_free(forecaster->output);
+    pthread_mutex_destroy(&forecaster->lock);
+    pthread_cond_destroy(&forecaster->sample_added);
+}
@@ -0,0 +1,88 @@
+#ifndef FORECASTER_H
+#define FORECASTER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fftw3.h>
+
+// In-process version of scripts/fft.py: the per-step transfer rates are
+// filtered in the frequency domain, keeping the bins whose magnitude reaches
+// mean + FORECAST_STD_FACTOR * std, and the reconstruction is read
+// periodically to forecast the following steps.
+
+// Steps of history the filter runs on
+#ifndef FORECAST_WINDOW
+#define FORECAST_WINDOW 64
+#endif
+
+// Samples needed before the first forecast is published (fft.py first ran
+// after 1200 s, 20 steps of 60 s)
+#ifndef FORECAST_MIN_SAMPLES
+#define FORECAST_MIN_SAMPLES 20
+#endif
+
+#define FORECAST_STD_FACTOR 0.25
+// fft.py replaces zero rates (failed measurements) with this, in Mbps
+#define FORECAST_ZERO_RATE 200.0
+
+// A published forecast: the filtered rates of steps first_step to
+// first_step + count - 1, repeating with period count. In time, rates[i]
+// holds from times[i] to times[i + 1] (seconds since the program started)
+// and the series repeats every times[count] - times[0] seconds; capacity[i]
+// is the Mbits the forecast carries from times[0] to times[i].
+typedef struct
+{
+    int first_step;
+    int count;
+    double mean_magnitude;
+    double std_magnitude;
+    double rates[FORECAST_WINDOW];
+    double times[FORECAST_WINDOW + 1];
+    double capacity[FORECAST_WINDOW + 1];
+} Forecast;
+
+typedef struct
+{
+    // Rate history, one sample per step with the time the step started,
+    // added by the sending thread
+    double history[FORECAST_WINDOW];
+    double history_times[FORECAST_WINDOW];
+    int next_step; // step after the newest sample
+    int count;
+    uint64_t added;    // samples added so far
+    uint64_t filtered; // samples the last forecast covered
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t sample_added;
+
+    // FFTW buffers and plans, a plan pair per window length made on its first use
+    double *input;
+    fftw_complex *spectrum;
+    double *output;
+    fftw_plan forward[FORECAST_WINDOW + 1];
+    fftw_plan backward[FORECAST_WINDOW + 1];
+
+    // The last forecast, behind a sequence lock: readers retry while it is odd or changed
+    atomic_uint sequence;
+    atomic_int published_first_step;
+    atomic_int published_count;
+    _Atomic double published_mean;
+    _Atomic double published_std;
+    _Atomic double published_rates[FORECAST_WINDOW];
+    _Atomic double published_times[FORECAST_WINDOW + 1];
+    _Atomic double published_capacity[FORECAST_WINDOW + 1];
+} Forecaster;
+
+bool forecaster_init(Forecaster *forecaster);
+void forecaster_add_sample(Forecaster *forecaster, int step, double start_seconds, double rate_mbps);
+bool forecaster_wait(Forecaster *forecaster);
+bool forecaster_update(Forecaster *forecaster);
+bool forecaster_read(Forecaster *forecaster, Forecast *forecast);
+double forecast_rate(const Forecast *forecast, int step);
+double forecast_capacity(const Forecast *forecast, double from, double to);
+void forecaster_close(Forecaster *forecaster);
+void forecaster_destroy(Forecaster *forecaster);
+
+#endif // FORECASTER_H
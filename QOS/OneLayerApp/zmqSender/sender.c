@@ -13,23 +13,38 @@
 #include <math.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include "pacer.h"
+#include "event_log.h"
+#include "chunk_pool.h"
+#include "forecaster.h"
 
 // General Parameters (ZMQ)
 #define BASE_PORT 5555
 #define SHARED_IP "10.10.10.4"
 #define DEDICATED_IP "10.10.10.8"
 #define NUM_STEPS 100
-#define CHUNK_SIZE 16 * 1024 * 1024
+// A new step starts every STEP_PERIOD seconds
+#define STEP_PERIOD 60.0
+// Files are read and sent in chunks of this size (a multiple of the 8-byte point)
+// from a pool of CHUNK_POOL_BUFFERS buffers per stream
+#define CHUNK_SIZE (16 * 1024 * 1024)
 #define DIRECTORY "../data/"
+// Binary telemetry, common/scripts/event_log_to_csv.py converts it
+#define EVENT_LOG_FILE "events.bin"
 
 // Bandwidth prediction parameters
 #define BW_MAX 370.0
 #define BW_MIN 0.0
 #define k1 (80.0 / (BW_MAX - BW_MIN))
 #define b1 (20.0 - (k1 * BW_MIN))
+// Seconds after a step starts by which its augmentation files should be sent
 #define TIME_WINDOW 25.0
 #define BANDWIDTH (400)
-#define MONITOR_SIZE 10000
+
+// 1: pace the augmentation stream in-process to the predicted bandwidth
+#ifndef APP_PACING
+#define APP_PACING 0
+#endif
 
 // Global shared resources
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -37,7 +52,6 @@ volatile bool stop_threads = false;
 void *context;
 int step_aug = 0;
 double elapsed_seconds = 0;
-int predictions_counter = 0;
 struct timeval program_start_time;
 
 typedef struct
@@ -47,14 +61,9 @@ typedef struct
     int thread_index;
 } ThreadArgs;
 
-typedef struct
-{
-    double time;
-    double rate;
-} Prediction;
-
-Prediction *predictions = NULL;
-int prediction_size = 0;
+// Forecasts the augmentation stream's rate from its measured step rates
+Forecaster forecaster;
+Pacer stream_pacers[2];
 
 void sleep_ms(double milliseconds)
 {
@@ -76,127 +85,47 @@ double get_elapsed_seconds()
     return seconds_diff + microseconds_diff;
 }
 
-// Function to read bandwidth predictions from file
-int read_predictions(FILE *file)
-{
-    char line[25];
-    int count = 0;
-
-    printf("Reading predictions\n");
-    while (fgets(line, sizeof(line), file) != NULL && count < MONITOR_SIZE)
-    {
-        char *time_str = strtok(line, ",");
-        char *rate_str = strtok(NULL, ",");
-
-        if (time_str != NULL && rate_str != NULL)
-        {
-            predictions[count].time = atof(time_str);
-            predictions[count].rate = atof(rate_str);
-            count++;
-        }
-    }
-    predictions_counter = count;
-    return count;
-}
-
-// Thread function to calculate congestion
+// Thread function to calculate congestion: refresh the forecast after every
+// measured step of the augmentation stream
 void *calculate_congestion(void *arg)
 {
+    (void)arg;
     printf("Starting congestion thread\n");
-    predictions = malloc(sizeof(Prediction) * MONITOR_SIZE);
-    if (!predictions)
+    while (forecaster_wait(&forecaster))
     {
-        perror("Failed to allocate memory for predictions");
-        return NULL;
-    }
-
-    char *prediction_filename = "predictions.txt";
-    while (!stop_threads)
-    {
-        sleep(1200);
-        FILE *prediction_file = fopen(prediction_filename, "r");
-        if (!prediction_file)
+        if (!forecaster_update(&forecaster))
         {
-            char command[1024];
-            snprintf(command, sizeof(command), "%s %s", "python3", "../scripts/fft.py");
-            int ret = system(command);
-            if (ret != 0)
-            {
-                fprintf(stderr, "Error executing command: %s\n", command);
-                break;
-            }
-
-            // Wait for file to be created
-            for (int i = 0; i < 10 && !prediction_file; i++)
-            {
-                sleep(1);
-                prediction_file = fopen(prediction_filename, "r");
-            }
-
-            if (!prediction_file)
-            {
-                fprintf(stderr, "Failed to open prediction file\n");
-                continue;
-            }
+            continue;
         }
-
+        Forecast forecast;
+        forecaster_read(&forecaster, &forecast);
         pthread_mutex_lock(&mutex);
-        prediction_size = read_predictions(prediction_file);
+        int next_step = step_aug;
         pthread_mutex_unlock(&mutex);
-
-        printf("Read %d predictions\n", prediction_size);
-        fclose(prediction_file);
-        printf("Processed congestion prediction until step %d\n", step_aug + 1);
+#if APP_PACING
+        // Predicted rates are in Mbps
+        pacer_set_rate(&stream_pacers[1], (uint64_t)(forecast_rate(&forecast, next_step) * 1000000.0));
+#endif
+        printf("Forecast from %d steps (magnitude threshold %.2f), step %d: %.2f Mbps\n", forecast.count,
+               forecast.mean_magnitude + FORECAST_STD_FACTOR * forecast.std_magnitude, next_step,
+               forecast_rate(&forecast, next_step));
     }
 
     printf("Exiting congestion thread\n");
     return NULL;
 }
 
-void log_chunk_transfer(double transfer_rate_mbps, int step)
+// Log the transfer rate of one timing sample the receiver reported
+void log_chunk_transfer(size_t bytes, double seconds, int step, int thread_index)
 {
-    pid_t pid = fork();
-
-    if (pid < 0)
-    {
-        // Fork failed
-        perror("Fork failed for logging");
-        return;
-    }
-    else if (pid == 0)
-    {
-        FILE *log_file;
-        // double elapsed_time = get_elapsed_seconds();
-        double elapsed_time = step * 60.0; // Assuming each step takes 40 seconds
-        if (access("log.txt", F_OK) != 0)
-        {
-            log_file = fopen("log.txt", "w");
-            if (log_file == NULL)
-            {
-                perror("Error creating log.txt");
-                exit(EXIT_FAILURE);
-            }
-            fprintf(log_file, "Time(s),File,Chunk Size(bytes),Transfer Rate(Mbps)\n");
-        }
-        else
-        {
-            log_file = fopen("log.txt", "a");
-            if (log_file == NULL)
-            {
-                perror("Error opening log.txt");
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        fprintf(log_file, "%.2f,%.2f\n",
-                elapsed_time,
-                transfer_rate_mbps);
-
-        fclose(log_file);
-        exit(EXIT_SUCCESS);
-    }
+    double transfer_rate_mbps = seconds > 0 ? (bytes * 8 / 1000000.0) / seconds : 0;
+    event_log(EVENT_CHUNK_RATE, thread_index, step, (double)bytes, transfer_rate_mbps);
+}
 
-    return;
+// Log the step's average transfer rate, steps start every STEP_PERIOD seconds
+void log_step_transfer(double transfer_rate_mbps, int step)
+{
+    event_log(EVENT_TRANSFER_RATE, 1, step, step * STEP_PERIOD, transfer_rate_mbps);
 }
 
 // Connect to socket
@@ -227,6 +156,100 @@ void send_data_chunk(void *socket, char *message, size_t size)
     zmq_msg_close(&msg);
 }
 
+// Announce a file: a message with its NUL-terminated name, then one with the
+// chunk size the receiver closes its timing samples on, in decimal
+void send_file_header(void *socket, char *filename)
+{
+    send_data_chunk(socket, filename, strlen(filename) + 1);
+    char chunk_size[32];
+    snprintf(chunk_size, sizeof(chunk_size), "%d", CHUNK_SIZE);
+    send_data_chunk(socket, chunk_size, strlen(chunk_size) + 1);
+}
+
+static void release_pool_chunk(void *data, void *hint)
+{
+    (void)data;
+    chunk_pool_release((PoolBuffer *)hint);
+}
+
+// Send size bytes of a pool buffer as PACER_SLICE_SIZE messages, each one released by the pacer.
+// Separate messages because ZeroMQ only flushes a multipart message on its last frame.
+// The messages point into the buffer, it goes back to the pool once ZeroMQ released them all.
+void send_paced_data(void *socket, Pacer *pacer, PoolBuffer *buffer, size_t size)
+{
+    size_t slice_size = APP_PACING ? PACER_SLICE_SIZE : size;
+    for (size_t sent = 0; sent < size; sent += slice_size)
+    {
+        size_t slice = (size - sent < slice_size) ? size - sent : slice_size;
+#if APP_PACING
+        pacer_wait(pacer, slice);
+#else
+        (void)pacer;
+#endif
+        zmq_msg_t msg;
+        chunk_pool_retain(buffer);
+        zmq_msg_init_data(&msg, buffer->data + sent, slice, release_pool_chunk, buffer);
+        if (zmq_msg_send(&msg, socket, 0) < 0)
+        {
+            fprintf(stderr, "Error sending data: %s\n", zmq_strerror(zmq_errno()));
+            zmq_msg_close(&msg);
+        }
+    }
+}
+
+// Read the file's first size bytes in CHUNK_SIZE chunks into pool buffers and
+// send them. Returns the bytes sent, less than size when the file is shorter.
+size_t send_file_prefix(void *socket, Pacer *pacer, ChunkPool *pool, FILE *file, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        size_t chunk = (size - sent < CHUNK_SIZE) ? size - sent : CHUNK_SIZE;
+        PoolBuffer *buffer = chunk_pool_acquire(pool);
+        size_t read = fread(buffer->data, 1, chunk, file);
+        // Only whole points go out
+        read -= read % 8;
+        if (read > 0)
+        {
+            send_paced_data(socket, pacer, buffer, read);
+        }
+        chunk_pool_release(buffer);
+        sent += read;
+        if (read < chunk)
+        {
+            fprintf(stderr, "Short read: %zu of %zu bytes sent\n", sent, size);
+            break;
+        }
+    }
+    return sent;
+}
+
+// Parse the receiver's timings, "<seconds for the file> <bytes>:<seconds> ...",
+// log every sample and add them to the step's totals
+void log_file_timings(const char *timings, int step, int thread_index, double *step_bytes, double *step_seconds)
+{
+    char *end;
+    strtod(timings, &end);
+    while (*end == ' ')
+    {
+        const char *sample = end + 1;
+        unsigned long long bytes = strtoull(sample, &end, 10);
+        if (end == sample || *end != ':')
+        {
+            break;
+        }
+        sample = end + 1;
+        double seconds = strtod(sample, &end);
+        if (end == sample)
+        {
+            break;
+        }
+        log_chunk_transfer((size_t)bytes, seconds, step, thread_index);
+        *step_bytes += bytes;
+        *step_seconds += seconds;
+    }
+}
+
 // Receive data chunk
 void recv_data_chunk(void *socket, char **data, size_t *size)
 {
@@ -277,34 +300,24 @@ size_t get_file_size(const char *filename)
     return size;
 }
 
-double get_file_percentage(size_t file_size)
+// Percentage of the augmentation files (total_bytes together) the forecast
+// capacity carries between now and the step's deadline, TIME_WINDOW seconds
+// after the step started
+double get_file_percentage(size_t total_bytes, double step_start)
 {
-    pthread_mutex_lock(&mutex);
     double percentage = 100;
-    if (predictions == NULL || prediction_size == 0)
+    Forecast forecast;
+    if (!forecaster_read(&forecaster, &forecast) || total_bytes == 0)
     {
-        pthread_mutex_unlock(&mutex);
         return percentage;
     }
 
-    // Convert file size to Mbits for consistent units
-    double file_size_Mbits = file_size * 8.0 / 1000000.0;
-
-    // Calculate average bandwidth over the next TIME_WINDOW seconds
-    double total_bandwidth = predictions[step_aug % predictions_counter].rate;
-
-    // Calculate average bandwidth over this window
-    double avg_predicted_bandwidth = total_bandwidth;
-    pthread_mutex_unlock(&mutex);
-
-    // Calculate how much data we can transfer in TIME_WINDOW seconds
-    // with the predicted bandwidth (in Mbits)
-    // double transfer_capacity = avg_predicted_bandwidth * TIME_WINDOW;
-
-    // Calculate what percentage of the file that representsa
-    printf("avg BW: %.2f\n", avg_predicted_bandwidth);
-    printf("step_aug: %d, predictions_counter: %d, %d\n", step_aug, predictions_counter, step_aug % predictions_counter);
-    percentage = (avg_predicted_bandwidth / BW_MAX) * 100.0;
+    // Predicted Mbits over the time actually left for the transfer
+    double now = get_elapsed_seconds();
+    double deadline = step_start + TIME_WINDOW;
+    double capacity_Mbits = forecast_capacity(&forecast, now, deadline);
+    double budget_bytes = capacity_Mbits * 1000000.0 / 8.0;
+    percentage = budget_bytes / total_bytes * 100.0;
 
     // Cap at 100% (can't transfer more than the entire file)
     if (percentage > 100.0)
@@ -313,9 +326,9 @@ double get_file_percentage(size_t file_size)
     }
 
     // For debugging
-    printf("Avg predicted bandwidth: %.2f Mbps\n", avg_predicted_bandwidth);
-    // printf("File size: %.2f Mbits, Transfer capacity: %.2f Mbits\n",
-    //        file_size_Mbits, transfer_capacity);
+    printf("Forecast of steps %d-%d, %.2f s to the deadline\n", forecast.first_step,
+           forecast.first_step + forecast.count - 1, deadline - now);
+    printf("Predicted capacity: %.2f Mbits, files: %.2f Mbits\n", capacity_Mbits, total_bytes * 8.0 / 1000000.0);
     printf("Percentage to send: %.2f%%\n", percentage);
 
     return percentage;
@@ -331,6 +344,13 @@ void *send_data(void *arg)
     void *sender;
 
     connect_socket(&sender, thread_index);
+    // Chunks are read into and sent from these buffers
+    ChunkPool *pool = chunk_pool_create(CHUNK_SIZE);
+    if (pool == NULL)
+    {
+        zmq_close(sender);
+        return NULL;
+    }
     int step = 0;
 
     while (step < NUM_STEPS && !stop_threads)
@@ -345,68 +365,62 @@ void *send_data(void *arg)
         double dynamic_progress_threshold = 100;
         if (thread_index == 1)
         {
-            dynamic_progress_threshold = get_file_percentage(get_file_size(filenames[0]) * 3);
+            size_t total_bytes = 0;
+            for (int i = 0; i < num_files; i++)
+            {
+                total_bytes += get_file_size(filenames[i]);
+            }
+            dynamic_progress_threshold = get_file_percentage(total_bytes, elapsed_seconds);
         }
 
         struct timeval start_step, end_step;
         gettimeofday(&start_step, NULL);
-        double data_size = 0;
-        double transfer_rate_mbps = 0;
-        double count = 0;
+        // Bytes and receive time of the step's timing samples
+        double step_bytes = 0;
+        double step_seconds = 0;
         for (int i = 0; i < num_files; i++)
         {
 
-            send_data_chunk(sender, filenames[i], strlen(filenames[i]) + 1);
+            send_file_header(sender, filenames[i]);
 
             FILE *file;
             if (open_file(&file, filenames[i]))
             {
                 zmq_close(sender);
+                chunk_pool_close(pool);
                 return NULL;
             }
 
-            // Send file data in chunks
+            // Send a percentage of the file based on dynamic_progress_threshold,
+            // cut on a point boundary
             size_t file_size = get_file_size(filenames[i]);
-            char *buffer = (char *)malloc(file_size);
-            if (!buffer)
-            {
-                perror("Failed to allocate memory for buffer");
-                fclose(file);
-                zmq_close(sender);
-                return NULL;
-            }
-            // Read a percentage of the file based on dynamic_progress_threshold
             size_t point_size = 8;
             size_t total_points = file_size / point_size;
             size_t points_to_send = (size_t)((dynamic_progress_threshold / 100.0) * total_points);
             size_t bytes_to_read = points_to_send * point_size;
-            size_t bytes_actually_read = fread(buffer, 1, bytes_to_read, file);
-
-            fclose(file);
 
             printf("File: %s, Size: %zu bytes (%zu points)\n",
                    filenames[i], file_size, total_points);
             printf("Sending %zu points (%zu bytes, %.2f%%)\n",
                    points_to_send, bytes_to_read, (float)points_to_send / total_points * 100);
-            send_data_chunk(sender, buffer, bytes_actually_read);
+            send_file_prefix(sender, &stream_pacers[thread_index], pool, file, bytes_to_read);
+            fclose(file);
+            // Empty message marks the end of the file data
+            send_data_chunk(sender, "", 0);
 
-            // Receive time taken from receiver
+            // Receive the timings from the receiver
             char *time_data;
             size_t time_data_size;
             recv_data_chunk(sender, &time_data, &time_data_size);
-            if (thread_index == 1)
-                printf("Received time taken: %s\n", time_data);
-
             if (time_data && time_data_size > 0)
             {
-                double chunk_transfer_time = atof(time_data);
-                transfer_rate_mbps += ((file_size * 8) / 1000000.0) / chunk_transfer_time;
-                count++;
+                time_data[time_data_size - 1] = '\0';
+                if (thread_index == 1)
+                    printf("Received time taken: %f\n", atof(time_data));
+                log_file_timings(time_data, step, thread_index, &step_bytes, &step_seconds);
                 free(time_data);
             }
 
-            free(buffer);
-
             // // Send empty chunk to signal end of file
             // send_data_chunk(sender, "", 0);
 
@@ -431,8 +445,10 @@ void *send_data(void *arg)
         // log the time taken for the file transfer
         if (thread_index == 1)
         {
-            printf("transfer rate: %.2f, count: %.2f, rate: %.2f\n", transfer_rate_mbps, count, transfer_rate_mbps / count);
-            log_chunk_transfer(transfer_rate_mbps / count, step);
+            double transfer_rate_mbps = step_seconds > 0 ? (step_bytes * 8 / 1000000.0) / step_seconds : 0;
+            printf("transfer rate: %.2f (%.0f bytes in %.3f s)\n", transfer_rate_mbps, step_bytes, step_seconds);
+            log_step_transfer(transfer_rate_mbps, step);
+            forecaster_add_sample(&forecaster, step, elapsed_seconds, transfer_rate_mbps);
             printf("\n--- Step %d completed ---\n", step);
             pthread_mutex_lock(&mutex);
             step_aug++;
@@ -441,7 +457,7 @@ void *send_data(void *arg)
 
         // Handle sleep between steps
         double send_time = get_elapsed_seconds() - elapsed_seconds;
-        double remaining = 60.0 - send_time;
+        double remaining = STEP_PERIOD - send_time;
 
         if (remaining > 0)
         {
@@ -452,6 +468,8 @@ void *send_data(void *arg)
     }
 
     zmq_close(sender);
+    // Freed once ZeroMQ released the last message
+    chunk_pool_close(pool);
     return NULL;
 }
 
@@ -459,9 +477,17 @@ int main()
 {
     gettimeofday(&program_start_time, NULL);
     printf("Starting Sender...\n");
+    event_log_open(EVENT_LOG_FILE);
 
     // Initialize ZeroMQ context
     context = zmq_ctx_new();
+    // Unlimited until a forecast assigns a rate
+    pacer_init(&stream_pacers[0], 0, 4 * PACER_SLICE_SIZE);
+    pacer_init(&stream_pacers[1], 0, 4 * PACER_SLICE_SIZE);
+    if (!forecaster_init(&forecaster))
+    {
+        return EXIT_FAILURE;
+    }
 
     // Create threads
     pthread_t thread1, thread2, congestion_thread;
@@ -494,18 +520,17 @@ int main()
 
     // Signal all threads to stop
     stop_threads = true;
+    forecaster_close(&forecaster);
 
     pthread_join(congestion_thread, NULL);
 
     // Clean up resources
-    if (predictions)
-    {
-        free(predictions);
-    }
+    forecaster_destroy(&forecaster);
 
     pthread_mutex_destroy(&mutex);
     zmq_ctx_destroy(context);
+    event_log_close();
 
-    printf("Transfer rates have been logged to log.txt\n");
+    printf("Transfer rates have been logged to %s\n", EVENT_LOG_FILE);
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE // fallocate
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "chunk_writer.h"
+
+// Same semantics as fopen(path, "ab") on name in directory dir_fd (AT_FDCWD
+// for a path): create the file or continue at its end
+bool chunk_writer_open(ChunkWriter *writer, int dir_fd, const char *name)
+{
+    writer->count = 0;
+    writer->pending_bytes = 0;
+    writer->fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (writer->fd < 0)
+    {
+        perror("Failed to open file");
+        return false;
+    }
+    writer->offset = lseek(writer->fd, 0, SEEK_END);
+    if (writer->offset < 0)
+    {
+        perror("lseek");
+        close(writer->fd);
+        writer->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Open a file whose final size is known and reserve its blocks up front, so
+// chunks can be written at their offsets in any order
+bool chunk_writer_open_sized(ChunkWriter *writer, int dir_fd, const char *name, off_t size)
+{
+    writer->count = 0;
+    writer->pending_bytes = 0;
+    writer->offset = 0;
+    writer->fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (writer->fd < 0)
+    {
+        perror("Failed to open file");
+        return false;
+    }
+    // Not every file system can preallocate, the writes still work without it
+    if (size > 0 && fallocate(writer->fd, 0, 0, size) != 0 && errno != EOPNOTSUPP)
+    {
+        perror("fallocate");
+    }
+    return true;
+}
+
+// Take over a received message (msg is left empty) to be written at the end
+// of the current batch
+bool chunk_writer_add(ChunkWriter *writer, zmq_msg_t *msg)
+{
+    return chunk_writer_add_at(writer, msg, writer->offset + writer->pending_bytes);
+}
+
+// Take over a received message that belongs at offset. It joins the current
+// batch when it continues it, otherwise the batch is written first.
+bool chunk_writer_add_at(ChunkWriter *writer, zmq_msg_t *msg, off_t offset)
+{
+    bool ok = true;
+    if (writer->count > 0 && offset != writer->offset + (off_t)writer->pending_bytes)
+    {
+        ok = chunk_writer_flush(writer);
+    }
+    if (writer->count == 0)
+    {
+        writer->offset = offset;
+    }
+    zmq_msg_t *held = &writer->msgs[writer->count];
+    zmq_msg_init(held);
+    zmq_msg_move(held, msg);
+    writer->iov[writer->count].iov_base = zmq_msg_data(held);
+    writer->iov[writer->count].iov_len = zmq_msg_size(held);
+    writer->pending_bytes += zmq_msg_size(held);
+    writer->count++;
+    if (writer->count == WRITE_BATCH || writer->pending_bytes >= WRITE_BATCH_BYTES)
+    {
+        ok = chunk_writer_flush(writer) && ok;
+    }
+    return ok;
+}
+
+// Write every held message with as few pwritev calls as the kernel allows,
+// then release them back to ZeroMQ
+bool chunk_writer_flush(ChunkWriter *writer)
+{
+    bool ok = true;
+    struct iovec *iov = writer->iov;
+    int iovcnt = writer->count;
+    while (iovcnt > 0)
+    {
+        ssize_t written = pwritev(writer->fd, iov, iovcnt, writer->offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("pwritev");
+            ok = false;
+            break;
+        }
+        writer->offset += written;
+        // Skip what a short write already covered
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    for (int i = 0; i < writer->count; i++)
+    {
+        zmq_msg_close(&writer->msgs[i]);
+    }
+    writer->count = 0;
+    writer->pending_bytes = 0;
+    return ok;
+}
+
+// Write what is held and cut the file to its final size (preallocated files
+// may have been sent only partially)
+bool chunk_writer_finish(ChunkWriter *writer, off_t size)
+{
+    if (writer->fd < 0)
+    {
+        return false;
+    }
+    bool ok = chunk_writer_flush(writer);
+    if (ftruncate(writer->fd, size) != 0)
+    {
+        perror("ftruncate");
+        ok = false;
+    }
+    close(writer->fd);
+    writer->fd = -1;
+    return ok;
+}
+
+bool chunk_writer_close(ChunkWriter *writer)
+{
+    if (writer->fd < 0)
+    {
+        return false;
+    }
+    bool ok = chunk_writer_flush(writer);
+    close(writer->fd);
+    writer->fd = -1;
+    return ok;
+}
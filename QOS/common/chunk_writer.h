@@ -0,0 +1,41 @@
+#ifndef CHUNK_WRITER_H
+#define CHUNK_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <zmq.h>
+
+// Received messages held per file before they are written with one pwritev
+#ifndef WRITE_BATCH
+#define WRITE_BATCH 16
+#endif
+
+// Flush earlier once this many bytes are held
+#ifndef WRITE_BATCH_BYTES
+#define WRITE_BATCH_BYTES (8 * 1024 * 1024)
+#endif
+
+// Writes received chunks to one file straight from the ZeroMQ message
+// buffers. The messages are kept until their batch is written, then closed.
+// A batch covers one contiguous range of the file.
+typedef struct
+{
+    int fd;
+    off_t offset; // file offset of the first held message
+    int count;
+    size_t pending_bytes;
+    zmq_msg_t msgs[WRITE_BATCH];
+    struct iovec iov[WRITE_BATCH];
+} ChunkWriter;
+
+bool chunk_writer_open(ChunkWriter *writer, int dir_fd, const char *name);
+bool chunk_writer_open_sized(ChunkWriter *writer, int dir_fd, const char *name, off_t size);
+bool chunk_writer_add(ChunkWriter *writer, zmq_msg_t *msg);
+bool chunk_writer_add_at(ChunkWriter *writer, zmq_msg_t *msg, off_t offset);
+bool chunk_writer_flush(ChunkWriter *writer);
+bool chunk_writer_close(ChunkWriter *writer);
+bool chunk_writer_finish(ChunkWriter *writer, off_t size);
+
+#endif // CHUNK_WRITER_H
@@ -0,0 +1,127 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dir_cache.h"
+
+// Create name under parent unless it exists and open it
+static int open_directory(int parent, const char *name)
+{
+    if (mkdirat(parent, name, S_IRWXU) != 0 && errno != EEXIST)
+    {
+        perror("mkdirat");
+        return -1;
+    }
+    int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("Failed to open directory");
+    }
+    return fd;
+}
+
+bool dir_cache_init(DirCache *cache, const char *root)
+{
+    cache->clock = 0;
+    for (int i = 0; i < DIR_CACHE_SIZE; i++)
+    {
+        cache->entries[i].fd = -1;
+    }
+    cache->root_fd = open_directory(AT_FDCWD, root);
+    return cache->root_fd >= 0;
+}
+
+// Returns the cached handle of the directory, or -1 when it is not open
+static int lookup(DirCache *cache, const char *category, int step)
+{
+    for (int i = 0; i < DIR_CACHE_SIZE; i++)
+    {
+        DirCacheEntry *entry = &cache->entries[i];
+        if (entry->fd >= 0 && entry->step == step && strcmp(entry->category, category) == 0)
+        {
+            entry->used = ++cache->clock;
+            return entry->fd;
+        }
+    }
+    return -1;
+}
+
+static void insert(DirCache *cache, const char *category, int step, int fd)
+{
+    DirCacheEntry *victim = &cache->entries[0];
+    for (int i = 0; i < DIR_CACHE_SIZE && victim->fd >= 0; i++)
+    {
+        DirCacheEntry *entry = &cache->entries[i];
+        if (entry->fd < 0 || entry->used < victim->used)
+        {
+            victim = entry;
+        }
+    }
+    if (victim->fd >= 0)
+    {
+        close(victim->fd);
+    }
+    snprintf(victim->category, sizeof(victim->category), "%s", category);
+    victim->step = step;
+    victim->fd = fd;
+    victim->used = ++cache->clock;
+}
+
+// Handle of root/<category>/<step>/, creating the directories on first use.
+// The handle is owned by the cache and stays open until enough other
+// directories were looked up to evict it, use it before moving to other steps.
+int dir_cache_get(DirCache *cache, const char *category, int step)
+{
+    int fd = lookup(cache, category, step);
+    if (fd >= 0)
+    {
+        return fd;
+    }
+
+    int parent = cache->root_fd;
+    if (category[0] != '\0')
+    {
+        parent = lookup(cache, category, -1);
+        if (parent < 0)
+        {
+            parent = open_directory(cache->root_fd, category);
+            if (parent < 0)
+            {
+                return -1;
+            }
+            insert(cache, category, -1, parent);
+        }
+        if (step < 0)
+        {
+            return parent;
+        }
+    }
+
+    char name[16];
+    snprintf(name, sizeof(name), "%d", step);
+    fd = open_directory(parent, name);
+    if (fd >= 0)
+    {
+        insert(cache, category, step, fd);
+    }
+    return fd;
+}
+
+void dir_cache_close(DirCache *cache)
+{
+    for (int i = 0; i < DIR_CACHE_SIZE; i++)
+    {
+        if (cache->entries[i].fd >= 0)
+        {
+            close(cache->entries[i].fd);
+            cache->entries[i].fd = -1;
+        }
+    }
+    if (cache->root_fd >= 0)
+    {
+        close(cache->root_fd);
+        cache->root_fd = -1;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Directories kept open per cache, the least recently used one is closed first
+#ifndef DIR_CACHE_SIZE
+#define DIR_CACHE_SIZE 32
+#endif
+
+#define DIR_CATEGORY_SIZE 32
+
+typedef struct
+{
+    char category[DIR_CATEGORY_SIZE];
+    int step; // -1 for the category directory itself
+    int fd;   // -1 when the slot is empty
+    uint64_t used;
+} DirCacheEntry;
+
+// Open directory handles under one output root, laid out as
+// root/<category>/<step>/ (root/<step>/ for an empty category). Each
+// directory is created and opened once; files are then created with openat
+// relative to it. Not thread-safe, every receiving thread owns its cache.
+typedef struct
+{
+    int root_fd;
+    uint64_t clock;
+    DirCacheEntry entries[DIR_CACHE_SIZE];
+} DirCache;
+
+bool dir_cache_init(DirCache *cache, const char *root);
+int dir_cache_get(DirCache *cache, const char *category, int step);
+void dir_cache_close(DirCache *cache);
+
+#endif // DIR_CACHE_H
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "event_log.h"
+
+// Records written per write() call
+#define EVENT_LOG_BATCH 256
+
+// A ring slot is free for the producer that claims position p when its
+// sequence is p, and holds a record for the flusher when it is p + 1
+typedef struct
+{
+    atomic_uint_fast64_t sequence;
+    EventRecord record;
+} EventSlot;
+
+static EventSlot ring[EVENT_LOG_CAPACITY];
+static atomic_uint_fast64_t enqueue_pos;
+static uint64_t dequeue_pos; // flusher only
+static atomic_uint_fast64_t dropped;
+static atomic_bool stopping;
+static bool running = false;
+static int log_fd = -1;
+static pthread_t flusher;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Queue an event, any thread. Returns false, and counts the event as
+// dropped, when the flusher is a full ring behind.
+bool event_log(EventType type, int source, int step, double a, double b)
+{
+    uint64_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    EventSlot *slot;
+    while (true)
+    {
+        slot = &ring[pos & (EVENT_LOG_CAPACITY - 1)];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int64_t diff = (int64_t)(sequence - pos);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+    slot->record = (EventRecord){
+        .time_ns = monotonic_ns(),
+        .type = (uint16_t)type,
+        .source = (uint16_t)source,
+        .step = step,
+        .a = a,
+        .b = b,
+    };
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+// Name a source (a stream) for the converter, up to 16 bytes are kept
+void event_log_name(int source, const char *name)
+{
+    double packed[2] = {0};
+    memcpy(packed, name, strnlen(name, sizeof(packed)));
+    event_log(EVENT_SOURCE_NAME, source, 0, packed[0], packed[1]);
+}
+
+static bool write_records(const EventRecord *records, int count)
+{
+    const char *data = (const char *)records;
+    size_t left = count * sizeof(EventRecord);
+    while (left > 0)
+    {
+        ssize_t written = write(log_fd, data, left);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error writing the event log");
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+// Move the queued records to the file. Returns how many were written.
+static int drain(void)
+{
+    EventRecord batch[EVENT_LOG_BATCH];
+    int total = 0;
+    int count;
+    do
+    {
+        count = 0;
+        while (count < EVENT_LOG_BATCH)
+        {
+            EventSlot *slot = &ring[dequeue_pos & (EVENT_LOG_CAPACITY - 1)];
+            if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != dequeue_pos + 1)
+            {
+                break;
+            }
+            batch[count++] = slot->record;
+            atomic_store_explicit(&slot->sequence, dequeue_pos + EVENT_LOG_CAPACITY, memory_order_release);
+            dequeue_pos++;
+        }
+        if (count > 0)
+        {
+            write_records(batch, count);
+            total += count;
+        }
+    } while (count == EVENT_LOG_BATCH);
+    return total;
+}
+
+static void *flusher_thread(void *arg)
+{
+    (void)arg;
+    struct timespec pause = {.tv_sec = EVENT_LOG_FLUSH_MS / 1000, .tv_nsec = (EVENT_LOG_FLUSH_MS % 1000) * 1000000L};
+    while (!atomic_load(&stopping))
+    {
+        if (drain() == 0)
+        {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Start logging to path. Runs are appended, each starts with an EVENT_SESSION record.
+bool event_log_open(const char *path)
+{
+    for (uint64_t i = 0; i < EVENT_LOG_CAPACITY; i++)
+    {
+        atomic_init(&ring[i].sequence, i);
+    }
+    atomic_init(&enqueue_pos, 0);
+    atomic_init(&dropped, 0);
+    atomic_init(&stopping, false);
+    dequeue_pos = 0;
+
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log_fd < 0)
+    {
+        perror(path);
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    event_log(EVENT_SESSION, EVENT_LOG_VERSION, 0, now.tv_sec + now.tv_nsec / 1e9, 0);
+    if (pthread_create(&flusher, NULL, flusher_thread, NULL) != 0)
+    {
+        perror("Failed to create the event log flusher");
+        close(log_fd);
+        log_fd = -1;
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+// Stop the flusher and write what is left. Call once the other threads stopped logging.
+void event_log_close(void)
+{
+    if (!running)
+    {
+        return;
+    }
+    atomic_store(&stopping, true);
+    pthread_join(flusher, NULL);
+    drain();
+    uint64_t lost = atomic_load(&dropped);
+    if (lost > 0)
+    {
+        fprintf(stderr, "Event log: %llu events dropped, the ring was full\n", (unsigned long long)lost);
+        event_log(EVENT_DROPPED, 0, 0, (double)lost, 0);
+        drain();
+    }
+    close(log_fd);
+    log_fd = -1;
+    running = false;
+}
@@ -0,0 +1,52 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Telemetry events are queued in a lock-free ring and written by a flusher
+// thread as fixed-size binary records, so logging never blocks or forks on
+// the data path. scripts/event_log_to_csv.py turns a log into CSV files.
+
+// Records the ring holds before events are dropped, must be a power of two
+#ifndef EVENT_LOG_CAPACITY
+#define EVENT_LOG_CAPACITY 4096
+#endif
+
+// How long the flusher sleeps when the ring is empty
+#ifndef EVENT_LOG_FLUSH_MS
+#define EVENT_LOG_FLUSH_MS 50
+#endif
+
+#define EVENT_LOG_VERSION 1
+
+typedef enum
+{
+    EVENT_SESSION = 0,   // log opened; source: format version, a: wall clock (s since epoch)
+    EVENT_SOURCE_NAME,   // a and b hold the source's name, up to 16 bytes
+    EVENT_STREAM_WINDOW, // a: window length (s), b: bytes received in it
+    EVENT_STEP_WAIT,     // a: time the step processor waited for the step (s)
+    EVENT_STEP_TIME,     // a: time the slowest stream took to receive the step (s)
+    EVENT_TRANSFER_RATE, // a: step start (s), b: transfer rate (Mbps)
+    EVENT_DROPPED,       // a: events dropped because the ring was full
+    EVENT_CHUNK_RATE,    // a: bytes in a timing sample of a file transfer, b: transfer rate (Mbps)
+} EventType;
+
+// On-disk record, native byte order. time_ns is CLOCK_MONOTONIC; the
+// EVENT_SESSION record that starts each run ties it to the wall clock.
+typedef struct
+{
+    uint64_t time_ns;
+    uint16_t type;
+    uint16_t source;
+    int32_t step;
+    double a;
+    double b;
+} EventRecord;
+
+bool event_log_open(const char *path);
+bool event_log(EventType type, int source, int step, double a, double b);
+void event_log_name(int source, const char *name);
+void event_log_close(void);
+
+#endif // EVENT_LOG_H
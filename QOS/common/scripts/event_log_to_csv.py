@@ -0,0 +1,133 @@
+import argparse
+import csv
+import os
+import struct
+from datetime import datetime
+
+# Converts the binary event log written by event_log.c to one CSV per event
+# type, or with --legacy to the text logs the programs used to write.
+
+RECORD = struct.Struct('=QHHidd')  # time_ns, type, source, step, a, b
+SUPPORTED_VERSION = 1
+
+EVENT_SESSION = 0
+EVENT_SOURCE_NAME = 1
+EVENT_STREAM_WINDOW = 2
+EVENT_STEP_WAIT = 3
+EVENT_STEP_TIME = 4
+EVENT_TRANSFER_RATE = 5
+EVENT_DROPPED = 6
+EVENT_CHUNK_RATE = 7
+
+# CSV name and the meaning of a and b for each event type
+EVENT_COLUMNS = {
+    EVENT_STREAM_WINDOW: ('stream_window', ['window_s', 'bytes']),
+    EVENT_STEP_WAIT: ('step_wait', ['wait_s']),
+    EVENT_STEP_TIME: ('step_time', ['time_s']),
+    EVENT_TRANSFER_RATE: ('transfer_rate', ['step_start_s', 'rate_mbps']),
+    EVENT_DROPPED: ('dropped', ['events']),
+    EVENT_CHUNK_RATE: ('chunk_rate', ['bytes', 'rate_mbps']),
+}
+
+
+def get_arguments():
+    parser = argparse.ArgumentParser(description='Event log to CSV converter')
+    parser.add_argument('log', help="Binary event log, e.g. ../data/events.bin")
+    parser.add_argument('--output', default=None, help="Output directory (default: next to the log)")
+    parser.add_argument('--legacy', action='store_true',
+                        help="Write log.txt and time_<stream>.txt as the programs used to")
+    return parser.parse_args()
+
+
+def read_events(path):
+    """Yield (session, wall_time, elapsed, type, source, step, a, b), a session per run in the file."""
+    session = -1
+    start_ns = 0
+    start_wall = 0.0
+    with open(path, 'rb') as file:
+        data = file.read()
+    usable = len(data) - len(data) % RECORD.size
+    for time_ns, event_type, source, step, a, b in RECORD.iter_unpack(data[:usable]):
+        if event_type == EVENT_SESSION:
+            if source != SUPPORTED_VERSION:
+                raise ValueError(f"{path}: unsupported event log version {source}")
+            session += 1
+            start_ns = time_ns
+            start_wall = a
+            continue
+        if session < 0:
+            raise ValueError(f"{path}: the log does not start with a session record")
+        elapsed = (time_ns - start_ns) / 1e9
+        yield session, start_wall + elapsed, elapsed, event_type, source, step, a, b
+
+
+def source_name(a, b):
+    return struct.pack('=dd', a, b).split(b'\0', 1)[0].decode(errors='replace')
+
+
+def write_csv(events, output):
+    writers = {}
+    files = []
+    names = {}
+    for session, wall_time, elapsed, event_type, source, step, a, b in events:
+        if event_type == EVENT_SOURCE_NAME:
+            names[(session, source)] = source_name(a, b)
+            continue
+        if event_type not in EVENT_COLUMNS:
+            continue
+        name, columns = EVENT_COLUMNS[event_type]
+        if event_type not in writers:
+            file = open(os.path.join(output, f"events_{name}.csv"), 'w', newline='')
+            files.append(file)
+            writers[event_type] = csv.writer(file)
+            writers[event_type].writerow(['session', 'time', 'elapsed_s', 'source', 'step'] + columns)
+        values = [a, b][:len(columns)]
+        label = names.get((session, source), source)
+        timestamp = datetime.fromtimestamp(wall_time).isoformat(timespec='microseconds')
+        writers[event_type].writerow([session, timestamp, f"{elapsed:.6f}", label, step] + values)
+    for file in files:
+        file.close()
+    return [EVENT_COLUMNS[t][0] for t in writers]
+
+
+def write_legacy(events, output):
+    # The event log holds every run, so the text logs are rewritten from it
+    files = {}
+    names = {}
+
+    def append(filename, line, header=None):
+        if filename not in files:
+            files[filename] = open(os.path.join(output, filename), 'w')
+            if header:
+                files[filename].write(header)
+        files[filename].write(line)
+
+    for session, wall_time, elapsed, event_type, source, step, a, b in events:
+        if event_type == EVENT_SOURCE_NAME:
+            names[(session, source)] = source_name(a, b)
+        elif event_type == EVENT_STREAM_WINDOW:
+            append(f"time_{names.get((session, source), source)}.txt", f"{a:.3f}, {b:.3f}\n")
+        elif event_type in (EVENT_STEP_WAIT, EVENT_STEP_TIME):
+            append("log.txt", f"{a:f}\n")
+        elif event_type == EVENT_TRANSFER_RATE:
+            append("log.txt", f"{a:.2f},{b:.2f}\n",
+                   header="Time(s),File,Chunk Size(bytes),Transfer Rate(Mbps)\n")
+    for file in files.values():
+        file.close()
+    return sorted(files)
+
+
+def main():
+    args = get_arguments()
+    output = args.output or os.path.dirname(os.path.abspath(args.log))
+    os.makedirs(output, exist_ok=True)
+    events = read_events(args.log)
+    if args.legacy:
+        written = write_legacy(events, output)
+    else:
+        written = write_csv(events, output)
+    print(f"Wrote {', '.join(written) or 'nothing'} to {output}")
+
+
+if __name__ == '__main__':
+    main()
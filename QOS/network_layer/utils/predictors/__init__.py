@@ -1,5 +1,6 @@
 from .predictor_base import Predictor
 from .fft_predictor import FftPredictor
 from .next_second_predictor import NextSecondPredictor
+from .sliding_dft_predictor import SlidingDftPredictor
 
-__all__ = ['Predictor', 'FftPredictor', 'NextSecondPredictor']
\ No newline at end of file
+__all__ = ['Predictor', 'FftPredictor', 'NextSecondPredictor', 'SlidingDftPredictor']
\ No newline at end of file
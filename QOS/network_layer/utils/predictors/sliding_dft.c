@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include "sliding_dft.h"
+
+typedef struct
+{
+    double magnitude;
+    int bin;
+} BinMagnitude;
+
+struct SlidingDft
+{
+    int window;
+    int max_bins;
+    int refresh;
+    double std_factor;
+    double *samples; // ring, position is the oldest sample once full
+    int position;
+    long long count;
+    int since_refresh;
+    // Full transform of the window: a radix-2 FFT of fft_size points, through
+    // Bluestein's chirp convolution when the window is not a power of two
+    int fft_size;
+    bool bluestein;
+    double *twiddle_re; // e^{-2 pi i j / fft_size}, j < fft_size / 2
+    double *twiddle_im;
+    double *chirp_re; // e^{-pi i j^2 / window}, j < window
+    double *chirp_im;
+    double *filter_re; // FFT of the conjugate chirp, wrapped around
+    double *filter_im;
+    double *work_re;
+    double *work_im;
+    BinMagnitude *spectrum;
+    double *spectrum_re;
+    double *spectrum_im;
+    // Tracked bins: X_k of the window (oldest sample first) and e^{2 pi i k / window}
+    int num_bins;
+    int *bins;
+    double *re;
+    double *im;
+    double *step_re;
+    double *step_im;
+};
+
+// In-place radix-2 FFT of size points, inverse (unnormalized) when asked
+static void fft(const SlidingDft *dft, double *re, double *im, int size, bool inverse)
+{
+    for (int i = 1, j = 0; i < size; i++)
+    {
+        int bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j |= bit;
+        if (i < j)
+        {
+            double t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+    double sign = inverse ? -1 : 1;
+    for (int length = 2; length <= size; length <<= 1)
+    {
+        int stride = size / length;
+        for (int start = 0; start < size; start += length)
+        {
+            for (int k = 0; k < length / 2; k++)
+            {
+                double w_re = dft->twiddle_re[k * stride];
+                double w_im = sign * dft->twiddle_im[k * stride];
+                int a = start + k;
+                int b = a + length / 2;
+                double t_re = re[b] * w_re - im[b] * w_im;
+                double t_im = re[b] * w_im + im[b] * w_re;
+                re[b] = re[a] - t_re;
+                im[b] = im[a] - t_im;
+                re[a] += t_re;
+                im[a] += t_im;
+            }
+        }
+    }
+}
+
+SlidingDft *sliding_dft_create(int window, int max_bins, double std_factor, int refresh)
+{
+    if (window < 2 || max_bins < 1)
+    {
+        return NULL;
+    }
+    SlidingDft *dft = calloc(1, sizeof(SlidingDft));
+    if (dft == NULL)
+    {
+        return NULL;
+    }
+    int half = window / 2 + 1;
+    dft->window = window;
+    dft->max_bins = max_bins < half ? max_bins : half;
+    dft->refresh = refresh > 0 ? refresh : window;
+    dft->std_factor = std_factor;
+    dft->bluestein = (window & (window - 1)) != 0;
+    // Bluestein's convolution needs room for 2 * window - 1 points
+    dft->fft_size = 1;
+    while (dft->fft_size < (dft->bluestein ? 2 * window - 1 : window))
+    {
+        dft->fft_size <<= 1;
+    }
+    int size = dft->fft_size;
+    dft->samples = calloc(window, sizeof(double));
+    dft->twiddle_re = malloc(size / 2 * sizeof(double));
+    dft->twiddle_im = malloc(size / 2 * sizeof(double));
+    dft->work_re = malloc(size * sizeof(double));
+    dft->work_im = malloc(size * sizeof(double));
+    dft->spectrum = malloc(half * sizeof(BinMagnitude));
+    dft->spectrum_re = malloc(half * sizeof(double));
+    dft->spectrum_im = malloc(half * sizeof(double));
+    dft->bins = malloc(dft->max_bins * sizeof(int));
+    dft->re = malloc(dft->max_bins * sizeof(double));
+    dft->im = malloc(dft->max_bins * sizeof(double));
+    dft->step_re = malloc(dft->max_bins * sizeof(double));
+    dft->step_im = malloc(dft->max_bins * sizeof(double));
+    if (dft->bluestein)
+    {
+        dft->chirp_re = malloc(window * sizeof(double));
+        dft->chirp_im = malloc(window * sizeof(double));
+        dft->filter_re = calloc(size, sizeof(double));
+        dft->filter_im = calloc(size, sizeof(double));
+    }
+    if (dft->samples == NULL || dft->twiddle_re == NULL || dft->twiddle_im == NULL || dft->work_re == NULL ||
+        dft->work_im == NULL || dft->spectrum == NULL || dft->spectrum_re == NULL || dft->spectrum_im == NULL ||
+        dft->bins == NULL || dft->re == NULL || dft->im == NULL || dft->step_re == NULL || dft->step_im == NULL ||
+        (dft->bluestein && (dft->chirp_re == NULL || dft->chirp_im == NULL || dft->filter_re == NULL || dft->filter_im == NULL)))
+    {
+        sliding_dft_destroy(dft);
+        return NULL;
+    }
+    for (int j = 0; j < size / 2; j++)
+    {
+        dft->twiddle_re[j] = cos(2 * M_PI * j / size);
+        dft->twiddle_im[j] = -sin(2 * M_PI * j / size);
+    }
+    if (dft->bluestein)
+    {
+        for (int j = 0; j < window; j++)
+        {
+            // j^2 mod 2 * window keeps the angle exact for long windows
+            double angle = M_PI * (double)(((long long)j * j) % (2LL * window)) / window;
+            dft->chirp_re[j] = cos(angle);
+            dft->chirp_im[j] = -sin(angle);
+            dft->filter_re[j] = dft->chirp_re[j];
+            dft->filter_im[j] = -dft->chirp_im[j];
+            if (j > 0)
+            {
+                dft->filter_re[size - j] = dft->chirp_re[j];
+                dft->filter_im[size - j] = -dft->chirp_im[j];
+            }
+        }
+        fft(dft, dft->filter_re, dft->filter_im, size, false);
+    }
+    return dft;
+}
+
+void sliding_dft_destroy(SlidingDft *dft)
+{
+    if (dft == NULL)
+    {
+        return;
+    }
+    free(dft->samples);
+    free(dft->twiddle_re);
+    free(dft->twiddle_im);
+    free(dft->chirp_re);
+    free(dft->chirp_im);
+    free(dft->filter_re);
+    free(dft->filter_im);
+    free(dft->work_re);
+    free(dft->work_im);
+    free(dft->spectrum);
+    free(dft->spectrum_re);
+    free(dft->spectrum_im);
+    free(dft->bins);
+    free(dft->re);
+    free(dft->im);
+    free(dft->step_re);
+    free(dft->step_im);
+    free(dft);
+}
+
+static int by_magnitude(const void *a, const void *b)
+{
+    double left = ((const BinMagnitude *)a)->magnitude;
+    double right = ((const BinMagnitude *)b)->magnitude;
+    return (left < right) - (left > right);
+}
+
+// Bins that stand for themselves and their mirror in the full spectrum
+static int mirror_weight(int bin, int window)
+{
+    return (bin == 0 || 2 * bin == window) ? 1 : 2;
+}
+
+// Bins 0 to window / 2 of the window's DFT, oldest sample first, in O(n log n)
+static void transform_window(SlidingDft *dft)
+{
+    int n = dft->window;
+    int size = dft->fft_size;
+    int half = n / 2 + 1;
+    double *re = dft->work_re;
+    double *im = dft->work_im;
+    for (int j = 0; j < size; j++)
+    {
+        re[j] = 0;
+        im[j] = 0;
+    }
+    for (int j = 0; j < n; j++)
+    {
+        double sample = dft->samples[(dft->position + j) % n];
+        re[j] = dft->bluestein ? sample * dft->chirp_re[j] : sample;
+        im[j] = dft->bluestein ? sample * dft->chirp_im[j] : 0;
+    }
+    fft(dft, re, im, size, false);
+    if (!dft->bluestein)
+    {
+        for (int k = 0; k < half; k++)
+        {
+            dft->spectrum_re[k] = re[k];
+            dft->spectrum_im[k] = im[k];
+        }
+        return;
+    }
+
+    // X_k = chirp_k * (x chirp convolved with the conjugate chirp)_k
+    for (int j = 0; j < size; j++)
+    {
+        double product_re = re[j] * dft->filter_re[j] - im[j] * dft->filter_im[j];
+        im[j] = re[j] * dft->filter_im[j] + im[j] * dft->filter_re[j];
+        re[j] = product_re;
+    }
+    fft(dft, re, im, size, true);
+    for (int k = 0; k < half; k++)
+    {
+        double conv_re = re[k] / size;
+        double conv_im = im[k] / size;
+        dft->spectrum_re[k] = conv_re * dft->chirp_re[k] - conv_im * dft->chirp_im[k];
+        dft->spectrum_im[k] = conv_re * dft->chirp_im[k] + conv_im * dft->chirp_re[k];
+    }
+}
+
+// Full transform of the window, then track DC and the strongest bins above the
+// threshold. Their values are taken exact from the transform, which also clears
+// the drift of the sliding updates.
+static void refresh_bins(SlidingDft *dft)
+{
+    int n = dft->window;
+    int half = n / 2 + 1;
+    transform_window(dft);
+    double sum = 0;
+    for (int k = 0; k < half; k++)
+    {
+        dft->spectrum[k].magnitude = hypot(dft->spectrum_re[k], dft->spectrum_im[k]);
+        dft->spectrum[k].bin = k;
+        sum += mirror_weight(k, n) * dft->spectrum[k].magnitude;
+    }
+    double mean = sum / n;
+    double variance = 0;
+    for (int k = 0; k < half; k++)
+    {
+        double deviation = dft->spectrum[k].magnitude - mean;
+        variance += mirror_weight(k, n) * deviation * deviation;
+    }
+    double threshold = mean + dft->std_factor * sqrt(variance / n);
+
+    // DC carries the level of the forecast and is always tracked
+    dft->num_bins = 0;
+    dft->bins[dft->num_bins++] = 0;
+    qsort(dft->spectrum + 1, half - 1, sizeof(BinMagnitude), by_magnitude);
+    for (int i = 1; i < half && dft->num_bins < dft->max_bins; i++)
+    {
+        if (dft->spectrum[i].magnitude < threshold)
+        {
+            break;
+        }
+        dft->bins[dft->num_bins++] = dft->spectrum[i].bin;
+    }
+
+    for (int i = 0; i < dft->num_bins; i++)
+    {
+        int k = dft->bins[i];
+        dft->re[i] = dft->spectrum_re[k];
+        dft->im[i] = dft->spectrum_im[k];
+        dft->step_re[i] = cos(2 * M_PI * k / n);
+        dft->step_im[i] = sin(2 * M_PI * k / n);
+    }
+    dft->since_refresh = 0;
+}
+
+// Slide the window by one sample: X_k <- (X_k + new - oldest) * e^{2 pi i k / n}
+void sliding_dft_update(SlidingDft *dft, double sample)
+{
+    double oldest = dft->samples[dft->position];
+    dft->samples[dft->position] = sample;
+    dft->position = (dft->position + 1) % dft->window;
+    dft->count++;
+    if (dft->count < dft->window)
+    {
+        return;
+    }
+    if (dft->count == dft->window || ++dft->since_refresh >= dft->refresh)
+    {
+        refresh_bins(dft);
+        return;
+    }
+    double delta = sample - oldest;
+    for (int i = 0; i < dft->num_bins; i++)
+    {
+        double re = dft->re[i] + delta;
+        double im = dft->im[i];
+        dft->re[i] = re * dft->step_re[i] - im * dft->step_im[i];
+        dft->im[i] = re * dft->step_im[i] + im * dft->step_re[i];
+    }
+}
+
+void sliding_dft_update_many(SlidingDft *dft, const double *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        sliding_dft_update(dft, samples[i]);
+    }
+}
+
+// Continue the tracked components past the newest sample: out[h - 1] is the
+// value h samples ahead. Returns the samples written, 0 until the window is full.
+int sliding_dft_forecast(const SlidingDft *dft, double *out, int horizon)
+{
+    int n = dft->window;
+    if (dft->count < n || dft->num_bins == 0)
+    {
+        return 0;
+    }
+    for (int h = 0; h < horizon; h++)
+    {
+        out[h] = 0;
+    }
+    for (int i = 0; i < dft->num_bins; i++)
+    {
+        // The first forecast sample is window index n, where e^{2 pi i k n / n} = 1
+        double phase_re = 1;
+        double phase_im = 0;
+        double weight = (double)mirror_weight(dft->bins[i], n) / n;
+        for (int h = 0; h < horizon; h++)
+        {
+            out[h] += weight * (dft->re[i] * phase_re - dft->im[i] * phase_im);
+            double re = phase_re * dft->step_re[i] - phase_im * dft->step_im[i];
+            phase_im = phase_re * dft->step_im[i] + phase_im * dft->step_re[i];
+            phase_re = re;
+        }
+    }
+    return horizon;
+}
+
+// The bins tracked now, DC first. Returns how many were copied.
+int sliding_dft_bins(const SlidingDft *dft, int *bins, int max_bins)
+{
+    int count = dft->num_bins < max_bins ? dft->num_bins : max_bins;
+    for (int i = 0; i < count; i++)
+    {
+        bins[i] = dft->bins[i];
+    }
+    return count;
+}
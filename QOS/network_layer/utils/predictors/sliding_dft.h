@@ -0,0 +1,24 @@
+#ifndef SLIDING_DFT_H
+#define SLIDING_DFT_H
+
+// Incremental spectrum of the last `window` samples for continuous forecasting.
+// Only the dominant bins are tracked, each new sample updates them in O(bins).
+// The bins are chosen, and recomputed exactly, from an O(n log n) FFT of the
+// window every `refresh` samples, keeping those whose magnitude reaches
+// mean + std_factor * std of the spectrum (the fft.py threshold). Amortized,
+// a sample costs O(bins + n log n / refresh), O(bins + log n) with the default
+// refresh of one window.
+//
+// Build the shared library SlidingDftPredictor loads with
+//   cc -O2 -shared -fPIC -o libsliding_dft.so sliding_dft.c -lm
+
+typedef struct SlidingDft SlidingDft;
+
+SlidingDft *sliding_dft_create(int window, int max_bins, double std_factor, int refresh);
+void sliding_dft_destroy(SlidingDft *dft);
+void sliding_dft_update(SlidingDft *dft, double sample);
+void sliding_dft_update_many(SlidingDft *dft, const double *samples, int count);
+int sliding_dft_forecast(const SlidingDft *dft, double *out, int horizon);
+int sliding_dft_bins(const SlidingDft *dft, int *bins, int max_bins);
+
+#endif // SLIDING_DFT_H
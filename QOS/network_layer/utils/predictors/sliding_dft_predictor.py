@@ -0,0 +1,196 @@
+import ctypes
+import os
+import numpy as np
+from . import Predictor
+
+# ------------------------------------------------------------------------------
+# Sliding-DFT Predictor
+# ------------------------------------------------------------------------------
+# Keeps the dominant bins of the window's spectrum up to date one sample at a
+# time (O(bins) per sample) instead of running a full FFT on every prediction.
+# The work is done by libsliding_dft.so (see sliding_dft.h) when it has been
+# built next to this file, and by the equivalent numpy code below otherwise.
+_LIBRARY_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libsliding_dft.so")
+
+
+def _load_library():
+    if not os.path.exists(_LIBRARY_PATH):
+        return None
+    lib = ctypes.CDLL(_LIBRARY_PATH)
+    lib.sliding_dft_create.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_double, ctypes.c_int]
+    lib.sliding_dft_create.restype = ctypes.c_void_p
+    lib.sliding_dft_destroy.argtypes = [ctypes.c_void_p]
+    lib.sliding_dft_destroy.restype = None
+    lib.sliding_dft_update.argtypes = [ctypes.c_void_p, ctypes.c_double]
+    lib.sliding_dft_update.restype = None
+    lib.sliding_dft_update_many.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.c_int]
+    lib.sliding_dft_update_many.restype = None
+    lib.sliding_dft_forecast.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.c_int]
+    lib.sliding_dft_forecast.restype = ctypes.c_int
+    lib.sliding_dft_bins.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    lib.sliding_dft_bins.restype = ctypes.c_int
+    return lib
+
+
+class _NumpySlidingDft:
+    """Same algorithm as sliding_dft.c, for when the library is not built."""
+
+    def __init__(self, window, max_bins, std_factor, refresh):
+        self.window = window
+        self.max_bins = min(max_bins, window // 2 + 1)
+        self.std_factor = std_factor
+        self.refresh = refresh if refresh and refresh > 0 else window
+        self.samples = np.zeros(window)
+        self.position = 0
+        self.count = 0
+        self.since_refresh = 0
+        self.bins = np.zeros(0, dtype=int)
+        self.coeffs = np.zeros(0, dtype=complex)
+        self.steps = np.zeros(0, dtype=complex)
+
+    def _refresh(self):
+        n = self.window
+        spectrum = np.fft.rfft(np.roll(self.samples, -self.position))
+        magnitudes = np.abs(spectrum)
+        # Every bin but DC (and Nyquist) also stands for its mirror
+        weights = np.full(len(magnitudes), 2.0)
+        weights[0] = 1.0
+        if n % 2 == 0:
+            weights[-1] = 1.0
+        mean = np.sum(weights * magnitudes) / n
+        std = np.sqrt(np.sum(weights * (magnitudes - mean) ** 2) / n)
+        threshold = mean + self.std_factor * std
+        # DC carries the level of the forecast and is always tracked
+        order = 1 + np.argsort(-magnitudes[1:], kind="stable")
+        strong = order[magnitudes[order] >= threshold][:self.max_bins - 1]
+        self.bins = np.concatenate(([0], strong)).astype(int)
+        self.coeffs = spectrum[self.bins]
+        self.steps = np.exp(2j * np.pi * self.bins / n)
+        self.since_refresh = 0
+
+    def update(self, sample):
+        oldest = self.samples[self.position]
+        self.samples[self.position] = sample
+        self.position = (self.position + 1) % self.window
+        self.count += 1
+        if self.count < self.window:
+            return
+        self.since_refresh += 1
+        if self.count == self.window or self.since_refresh >= self.refresh:
+            self._refresh()
+            return
+        self.coeffs = (self.coeffs + (sample - oldest)) * self.steps
+
+    def update_many(self, samples):
+        for sample in samples:
+            self.update(float(sample))
+
+    def forecast(self, horizon):
+        n = self.window
+        if self.count < n or len(self.bins) == 0:
+            return np.zeros(0)
+        weights = np.where((self.bins == 0) | (2 * self.bins == n), 1.0, 2.0) / n
+        # The first forecast sample is window index n, a whole period after index 0
+        phases = np.exp(2j * np.pi * np.outer(np.arange(horizon), self.bins) / n)
+        return np.real(phases * self.coeffs) @ weights
+
+    def tracked_bins(self):
+        return [int(k) for k in self.bins]
+
+
+class SlidingDftPredictor(Predictor):
+    def __init__(self, window_seconds=180, sleep_sec=1, max_bins=16, std_factor=0.25, refresh=None, use_c=True):
+        """
+        :param window_seconds: Total window of history to consider (in seconds).
+        :param sleep_sec: Sampling interval (in seconds).
+        :param max_bins: Most bins tracked, DC included.
+        :param std_factor: Bins need a magnitude of mean + std_factor * std to be tracked.
+        :param refresh: Samples between full DFTs that re-pick the bins (default: one window).
+        :param use_c: Use libsliding_dft.so when it is available.
+        """
+        self.window_seconds = window_seconds
+        self.sleep_sec = sleep_sec
+        self.required_history = window_seconds // sleep_sec  # number of samples needed
+        self.last_window = None  # the window predict() saw last, to find the new samples
+        self._lib = _load_library() if use_c else None
+        if self._lib is not None:
+            self._handle = self._lib.sliding_dft_create(self.required_history, max_bins, std_factor, refresh or 0)
+            if not self._handle:
+                raise ValueError("Could not create the sliding DFT.")
+        else:
+            self._dft = _NumpySlidingDft(self.required_history, max_bins, std_factor, refresh)
+
+    def __del__(self):
+        if getattr(self, "_lib", None) is not None and getattr(self, "_handle", None):
+            self._lib.sliding_dft_destroy(self._handle)
+            self._handle = None
+
+    def update(self, samples):
+        """
+        Slide the window over one sample or a sequence of samples.
+        """
+        samples = np.atleast_1d(np.asarray(samples, dtype=np.float64))
+        if self._lib is None:
+            self._dft.update_many(samples)
+            return
+        samples = np.ascontiguousarray(samples)
+        self._lib.sliding_dft_update_many(
+            self._handle, samples.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), len(samples))
+
+    def forecast(self, n_predict):
+        """
+        Extend the tracked components past the newest sample.
+
+        :param n_predict: Number of future samples to predict.
+        :return: Predicted future values as a numpy array, empty until a window has been seen.
+        """
+        if self._lib is None:
+            return self._dft.forecast(n_predict)
+        out = np.zeros(n_predict)
+        written = self._lib.sliding_dft_forecast(
+            self._handle, out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), n_predict)
+        return out[:written]
+
+    def tracked_bins(self):
+        """
+        The frequency bins currently tracked, DC first.
+        """
+        if self._lib is None:
+            return self._dft.tracked_bins()
+        bins = (ctypes.c_int * self.required_history)()
+        count = self._lib.sliding_dft_bins(self._handle, bins, self.required_history)
+        return list(bins[:count])
+
+    def _new_samples(self, window):
+        """
+        The samples of window that the last one did not have. Calls are usually
+        a sample apart; when the windows do not overlap the whole one is new.
+        """
+        if self.last_window is None:
+            return window
+        if np.array_equal(window, self.last_window):
+            return window[:0]
+        n = len(window)
+        for shift in range(1, n):
+            if np.array_equal(window[:n - shift], self.last_window[shift:]):
+                return window[n - shift:]
+        return window
+
+    def predict(self, port_data):
+        """
+        Generate a prediction based on the input port_data.
+        It expects port_data to be an array-like sequence of values (e.g. rx_bytes),
+        and uses only the most recent required_history samples. Only the samples
+        added since the last call are fed to the sliding DFT.
+
+        :param port_data: A list or array of numeric data points.
+        :return: A numpy array with the predicted future values.
+        :raises ValueError: if insufficient history is provided.
+        """
+        if len(port_data) < self.required_history:
+            raise ValueError(f"Not enough data to perform prediction (requires {self.required_history} samples).")
+
+        window = np.array(port_data[-self.required_history:], dtype=np.float64)
+        self.update(self._new_samples(window))
+        self.last_window = window
+        return self.forecast(self.required_history)